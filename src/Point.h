@@ -68,7 +68,7 @@ public:
 			coords[i] -= rhs[i];
 		}
 	}
-	bool operator==(const Point<DIM, T>& rhs) {
+	bool operator==(const Point<DIM, T>& rhs) const {
 		for (int i = 0; i < DIM; i++) {
 			if (coords[i] != rhs[i]) return false;
 		}
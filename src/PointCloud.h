@@ -0,0 +1,183 @@
+/*
+  Copyright (c) 2019 CNRS
+  Nicolas Bonneel <nicolas.bonneel@liris.cnrs.fr>
+  David Coeurjolly <david.coeurjolly@liris.cnrs.fr>
+
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIEDi
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "Point.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Aligned allocations, in UnbalancedSliced.cpp.
+void * malloc_simd(const size_t size, const size_t alignment);
+void free_simd(void* mem);
+
+/// @brief A cloud of many-dimensional samples, stored as one array per coordinate (structure of arrays).
+/// @details Unlike std::vector<Point<DIM, T> >, the c-th coordinates of consecutive samples are contiguous : loops over the
+/// samples of a coordinate are unit-stride, and are vectorized by the compiler. Each coordinate array is aligned on, and
+/// padded with zeroes to, simd_alignment bytes : kernels may process stride() samples without a remainder loop.
+/// Converts from and to std::vector<Point<DIM, T> > with assign() and copy_to().
+/// @tparam DIM The dimensionality of the samples.
+/// @tparam T The internal data type of the samples.
+template<int DIM, typename T>
+class PointCloud {
+public:
+	/// @brief Alignment of the coordinate arrays, in bytes : the widest SIMD registers (AVX-512).
+	static constexpr int simd_alignment = 64;
+	/// @brief Number of samples in simd_alignment bytes of a coordinate.
+	static constexpr int simd_lanes = simd_alignment / sizeof(T);
+
+	/// @brief Default ctor. Initializes an empty cloud.
+	PointCloud() = default;
+	/// @brief Initializes a cloud of n samples at the origin.
+	explicit PointCloud(int n) { this->resize(n); }
+	/// @brief Initializes the cloud with a copy of the given samples.
+	explicit PointCloud(const std::vector<Point<DIM, T> >& points) { this->assign(points); }
+	PointCloud(const PointCloud& other) { *this = other; }
+	PointCloud(PointCloud&& other) noexcept { this->swap(other); }
+	~PointCloud() { free_simd(this->samples); }
+
+	/// @brief Copies the samples of other, re-using the memory of this cloud if it is large enough.
+	PointCloud& operator=(const PointCloud& other) {
+		if (this != &other) {
+			this->resize(other.n, false);
+			for (int c = 0; c < DIM && this->n > 0; c++) {
+				std::memcpy(this->coord(c), other.coord(c), this->stride() * sizeof(T));
+			}
+		}
+		return *this;
+	}
+	PointCloud& operator=(PointCloud&& other) noexcept {
+		this->swap(other);
+		return *this;
+	}
+
+	void swap(PointCloud& other) noexcept {
+		std::swap(this->samples, other.samples);
+		std::swap(this->n, other.n);
+		std::swap(this->capacity, other.capacity);
+	}
+
+	/// @brief Resizes the cloud to n samples. The first samples are kept, and new ones are at the origin.
+	/// @details Only re-allocates if n is larger than the capacity of the cloud.
+	void resize(int n) { this->resize(n, true); }
+
+	/// @brief Moves all the samples to the origin, keeping their number.
+	void set_zero() {
+		for (int c = 0; c < DIM; c++) {
+			std::fill(this->coord(c), this->coord(c) + this->stride(), T(0));
+		}
+	}
+
+	/// @brief Copies the samples of points into the cloud (array of structures to structure of arrays).
+	void assign(const std::vector<Point<DIM, T> >& points) {
+		const int size = static_cast<int>(points.size());
+		this->resize(size, false);
+		for (int c = 0; c < DIM; c++) {
+			T* x = this->coord(c);
+			for (int i = 0; i < size; i++) {
+				x[i] = points[i][c];
+			}
+		}
+	}
+
+	/// @brief Copies the samples of the cloud into points, resized to size() (structure of arrays to array of structures).
+	void copy_to(std::vector<Point<DIM, T> >& points) const {
+		points.resize(this->n);
+		for (int c = 0; c < DIM; c++) {
+			const T* x = this->coord(c);
+			for (int i = 0; i < this->n; i++) {
+				points[i][c] = x[i];
+			}
+		}
+	}
+
+	/// @brief Returns the samples of the cloud as an array of structures.
+	std::vector<Point<DIM, T> > points() const {
+		std::vector<Point<DIM, T> > points;
+		this->copy_to(points);
+		return points;
+	}
+
+	/// @brief Returns a copy of the i-th sample.
+	Point<DIM, T> operator[](int i) const {
+		Point<DIM, T> p;
+		for (int c = 0; c < DIM; c++) {
+			p[c] = this->coord(c)[i];
+		}
+		return p;
+	}
+
+	/// @brief Sets the i-th sample to p.
+	void set(int i, const Point<DIM, T>& p) {
+		for (int c = 0; c < DIM; c++) {
+			this->coord(c)[i] = p[c];
+		}
+	}
+
+	/// @brief Returns the array of the c-th coordinates of the samples, aligned on simd_alignment bytes.
+	T* coord(int c) { return this->samples + static_cast<std::size_t>(c) * this->capacity; }
+	/// @brief Returns the array of the c-th coordinates of the samples, aligned on simd_alignment bytes.
+	const T* coord(int c) const { return this->samples + static_cast<std::size_t>(c) * this->capacity; }
+
+	/// @brief Returns the memory of the cloud, which identifies it while it is not re-allocated.
+	const T* data() const { return this->samples; }
+	/// @brief Returns the number of samples.
+	std::size_t size() const { return static_cast<std::size_t>(this->n); }
+	bool empty() const { return this->n == 0; }
+	/// @brief Returns size() rounded up to simd_lanes : the coordinates past size() up to stride() are zeroes.
+	int stride() const { return (this->n + simd_lanes - 1) / simd_lanes * simd_lanes; }
+
+private:
+	/// @brief Resizes the cloud to n samples, keeping the first ones if keep is true, and zeroes the padding.
+	/// @details If keep is false, the samples are left for the caller to write : only the padding is zeroed.
+	void resize(int n, bool keep) {
+		const int stride = (n + simd_lanes - 1) / simd_lanes * simd_lanes;
+		if (stride > this->capacity) {
+			T* samples = static_cast<T*>(malloc_simd(static_cast<std::size_t>(DIM) * stride * sizeof(T), simd_alignment));
+			if (keep) {
+				for (int c = 0; c < DIM; c++) {
+					std::memcpy(samples + static_cast<std::size_t>(c) * stride, this->coord(c), this->n * sizeof(T));
+				}
+			}
+			free_simd(this->samples);
+			this->samples = samples;
+			this->capacity = stride;
+		}
+		const int kept = keep ? std::min(this->n, n) : n;
+		for (int c = 0; c < DIM; c++) {
+			std::fill(this->coord(c) + kept, this->coord(c) + stride, T(0));
+		}
+		this->n = n;
+	}
+
+	T* samples = nullptr; ///< The coordinate arrays, one after the other.
+	int n = 0; ///< The number of samples.
+	int capacity = 0; ///< The number of samples each coordinate array can hold : the distance between them.
+};
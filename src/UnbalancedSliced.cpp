@@ -33,130 +33,393 @@
 #endif
 
 
-// cost function in 1-d ; simply used the quadratic cost
-double cost(double x, double y) {
-	const double z = x - y;
-	return z*z;
+#include <cstdlib>
+#include <string>
+
+// index of the lowest set bit of a non-zero mask
+static inline int lowest_bit(unsigned int mask) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+//region --- Scalar kernels ---
+// sum the cost of consecutively matching the first n values in h1 starting from start1 to the first n consecutive values of h2 starting at start2
+template<typename T>
+static T sum_costs_scalar(const T* h1, int start1, const T* h2, int start2, int n) {
+	T s = 0;
+	const T* h1p = &h1[start1];
+	const T* h2p = &h2[start2];
+	for (int j = 0; j < n; j++) {
+		s += cost(*h1p, *h2p); h1p++;  h2p++;
+	}
+	return s;
 }
-float cost(float x, float y) {
-	//return std::abs(x - y);
-	const float z = x - y;
-	return z*z;
+
+// first index j in [start, end) such that h[j] > value, or end if there is none. h is sorted.
+template<typename T>
+static int first_greater_scalar(const T* h, int start, int end, T value) {
+	for (int j = start; j < end; j++) {
+		if (h[j] > value) return j;
+	}
+	return end;
 }
-__m256d cost(const __m256d &x, const __m256d &y) {
-	__m256d diff = _mm256_sub_pd(x, y);
-	return _mm256_mul_pd(diff, diff);
+//endregion
+
+// The SIMD variants below all follow the scalar kernels above. The sumCosts() variants suppose h1 is aligned to 256
+// bits (see malloc_simd()) : they first match values one by one until h1 is aligned to their vector width, and use
+// aligned loads on h1 afterwards (unaligned ones for AVX-512, since h1 is not guaranteed to be aligned to 512 bits).
+// The first_greater() variants are merge-style linear searches, for results expected to be close to start.
+#if SPOT_SIMD_X86
+
+//region --- SSE4.2 kernels ---
+SPOT_TARGET("sse4.2")
+static double sum_costs_sse42(const double* h1, int start1, const double* h2, int start2, int n) {
+	double s = 0;
+	while (start1 % 2 != 0 && n > 0) {
+		s += cost(h1[start1++], h2[start2++]);
+		n--;
+	}
+	__m128d acc = _mm_setzero_pd();
+	int j = 0;
+	for (; j + 2 <= n; j += 2) {
+		const __m128d diff = _mm_sub_pd(_mm_load_pd(h1 + start1 + j), _mm_loadu_pd(h2 + start2 + j));
+		acc = _mm_add_pd(acc, _mm_mul_pd(diff, diff));
+	}
+	alignas(16) double lanes[2];
+	_mm_store_pd(lanes, acc);
+	s += lanes[0] + lanes[1];
+	return s + sum_costs_scalar(h1, start1 + j, h2, start2 + j, n - j);
 }
-__m256 cost(const __m256 &x, const __m256 &y) {
-	__m256 diff = _mm256_sub_ps(x, y);
-	return _mm256_mul_ps(diff, diff);
+
+SPOT_TARGET("sse4.2")
+static float sum_costs_sse42(const float* h1, int start1, const float* h2, int start2, int n) {
+	float s = 0;
+	while (start1 % 4 != 0 && n > 0) {
+		s += cost(h1[start1++], h2[start2++]);
+		n--;
+	}
+	__m128 acc = _mm_setzero_ps();
+	int j = 0;
+	for (; j + 4 <= n; j += 4) {
+		const __m128 diff = _mm_sub_ps(_mm_load_ps(h1 + start1 + j), _mm_loadu_ps(h2 + start2 + j));
+		acc = _mm_add_ps(acc, _mm_mul_ps(diff, diff));
+	}
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, acc);
+	s += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	return s + sum_costs_scalar(h1, start1 + j, h2, start2 + j, n - j);
 }
 
+SPOT_TARGET("sse4.2")
+static int first_greater_sse42(const double* h, int start, int end, double value) {
+	const __m128d v = _mm_set1_pd(value);
+	int j = start;
+	for (; j + 2 <= end; j += 2) {
+		const int mask = _mm_movemask_pd(_mm_cmpgt_pd(_mm_loadu_pd(h + j), v));
+		if (mask) return j + lowest_bit(mask);
+	}
+	return first_greater_scalar(h, j, end, value);
+}
 
-// sum the cost of consecutively matching the first n values in h1 starting from start1 to the first n consecutive values of h2 starting at start2
-// uses AVX : supposes h1 is aligned to 256 bits ; h2 need not be aligned
-double sumCosts(const double* h1, int start1, const double* h2, int start2, int n) {
-	if (n < 32) {
-		double s = 0;
-		const double* h1p = &h1[start1];
-		const double* h2p = &h2[start2];
-		for (int j = 0; j <n; j++) {
-			s += cost(*h1p, *h2p); h1p++;  h2p++;
-		}
-		return s;
+SPOT_TARGET("sse4.2")
+static int first_greater_sse42(const float* h, int start, int end, float value) {
+	const __m128 v = _mm_set1_ps(value);
+	int j = start;
+	for (; j + 4 <= end; j += 4) {
+		const int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(h + j), v));
+		if (mask) return j + lowest_bit(mask);
 	}
-	// AVX ; supposes h1 aligned
+	return first_greater_scalar(h, j, end, value);
+}
+//endregion
+
+//region --- AVX2 + FMA kernels ---
+SPOT_TARGET("avx2,fma")
+static double sum_costs_avx2(const double* h1, int start1, const double* h2, int start2, int n) {
 	double s = 0;
-	while (start1 % 4 != 0) {
-		s += cost(h1[start1], h2[start2]);
-		start1++;
-		start2++;
+	while (start1 % 4 != 0 && n > 0) {
+		s += cost(h1[start1++], h2[start2++]);
 		n--;
 	}
-	const double* h1p = &h1[start1];
-	const double* h2p = &h2[start2];
-	__m256d s2 = _mm256_setzero_pd();
-	for (int j = 0; j < n-3; j+=4) {
-		__m256d hm1 = _mm256_load_pd(h1p);
-		__m256d hm2 = _mm256_loadu_pd(h2p);
-		s2 = _mm256_add_pd(s2, cost(hm1, hm2)); h1p+=4;  h2p+=4;
-	}
-	s2 = _mm256_hadd_pd(s2, s2);
-	s += ((double*)&s2)[0] + ((double*)&s2)[2];
-	for (int j = n-3; j < n; j++) {
-		s += cost(*h1p, *h2p); h1p++;  h2p++;
+	__m256d acc = _mm256_setzero_pd();
+	int j = 0;
+	for (; j + 4 <= n; j += 4) {
+		const __m256d diff = _mm256_sub_pd(_mm256_load_pd(h1 + start1 + j), _mm256_loadu_pd(h2 + start2 + j));
+		acc = _mm256_fmadd_pd(diff, diff, acc);
 	}
-	return s;
+	alignas(32) double lanes[4];
+	_mm256_store_pd(lanes, acc);
+	s += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	return s + sum_costs_scalar(h1, start1 + j, h2, start2 + j, n - j);
 }
 
-#if defined(__GNUC__)
-#define PORTABLE_ALIGN16 __attribute__((aligned(16)))
-#else
-#define PORTABLE_ALIGN16 __declspec(align(16))
-#endif
+SPOT_TARGET("avx2,fma")
+static float sum_costs_avx2(const float* h1, int start1, const float* h2, int start2, int n) {
+	float s = 0;
+	while (start1 % 8 != 0 && n > 0) {
+		s += cost(h1[start1++], h2[start2++]);
+		n--;
+	}
+	__m256 acc = _mm256_setzero_ps();
+	int j = 0;
+	for (; j + 8 <= n; j += 8) {
+		const __m256 diff = _mm256_sub_ps(_mm256_load_ps(h1 + start1 + j), _mm256_loadu_ps(h2 + start2 + j));
+		acc = _mm256_fmadd_ps(diff, diff, acc);
+	}
+	alignas(32) float lanes[8];
+	_mm256_store_ps(lanes, acc);
+	s += lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+	return s + sum_costs_scalar(h1, start1 + j, h2, start2 + j, n - j);
+}
 
-float sum8(__m256 x) {
-	/*// hiQuad = ( x7, x6, x5, x4 )
-	const __m128 hiQuad = _mm256_extractf128_ps(x, 1);
-	// loQuad = ( x3, x2, x1, x0 )
-	const __m128 loQuad = _mm256_castps256_ps128(x);
-	// sumQuad = ( x3 + x7, x2 + x6, x1 + x5, x0 + x4 )
-	const __m128 sumQuad = _mm_add_ps(loQuad, hiQuad);
-	// loDual = ( -, -, x1 + x5, x0 + x4 )
-	const __m128 loDual = sumQuad;
-	// hiDual = ( -, -, x3 + x7, x2 + x6 )
-	const __m128 hiDual = _mm_movehl_ps(sumQuad, sumQuad);
-	// sumDual = ( -, -, x1 + x3 + x5 + x7, x0 + x2 + x4 + x6 )
-	const __m128 sumDual = _mm_add_ps(loDual, hiDual);
-	// lo = ( -, -, -, x0 + x2 + x4 + x6 )
-	const __m128 lo = sumDual;
-	// hi = ( -, -, -, x1 + x3 + x5 + x7 )
-	const __m128 hi = _mm_shuffle_ps(sumDual, sumDual, 0x1);
-	// sum = ( -, -, -, x0 + x1 + x2 + x3 + x4 + x5 + x6 + x7 )
-	const __m128 sum = _mm_add_ss(lo, hi);
-	return _mm_cvtss_f32(sum);*/
-
-	float PORTABLE_ALIGN16 TmpRes[8];
-	_mm256_store_ps(TmpRes, x);
-	return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] +
-		TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7];
+SPOT_TARGET("avx2,fma")
+static int first_greater_avx2(const double* h, int start, int end, double value) {
+	const __m256d v = _mm256_set1_pd(value);
+	int j = start;
+	for (; j + 4 <= end; j += 4) {
+		const int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(h + j), v, _CMP_GT_OQ));
+		if (mask) return j + lowest_bit(mask);
+	}
+	return first_greater_scalar(h, j, end, value);
 }
 
-// sum the cost of consecutively matching the first n values in h1 starting from start1 to the first n consecutive values of h2 starting at start2
-// uses AVX : supposes h1 is aligned to 256 bits ; h2 need not be aligned
-float sumCosts(const float* h1, int start1, const float* h2, int start2, int n) {
-	float s2b = -1;
-	if (n < 32) {
-		float s = 0;
-		const float* h1p = &h1[start1];
-		const float* h2p = &h2[start2];
-		for (int j = 0; j < n; j++) {
-			s += cost(*h1p, *h2p); h1p++;  h2p++;
-		}
-		return s;
+SPOT_TARGET("avx2,fma")
+static int first_greater_avx2(const float* h, int start, int end, float value) {
+	const __m256 v = _mm256_set1_ps(value);
+	int j = start;
+	for (; j + 8 <= end; j += 8) {
+		const int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(h + j), v, _CMP_GT_OQ));
+		if (mask) return j + lowest_bit(mask);
+	}
+	return first_greater_scalar(h, j, end, value);
+}
+//endregion
+
+//region --- AVX-512 kernels ---
+SPOT_TARGET("avx512f")
+static double sum_costs_avx512(const double* h1, int start1, const double* h2, int start2, int n) {
+	double s = 0;
+	while (start1 % 8 != 0 && n > 0) {
+		s += cost(h1[start1++], h2[start2++]);
+		n--;
 	}
-	// AVX ; supposes h1 aligned
+	__m512d acc = _mm512_setzero_pd();
+	int j = 0;
+	for (; j + 8 <= n; j += 8) {
+		const __m512d diff = _mm512_sub_pd(_mm512_loadu_pd(h1 + start1 + j), _mm512_loadu_pd(h2 + start2 + j));
+		acc = _mm512_fmadd_pd(diff, diff, acc);
+	}
+	alignas(64) double lanes[8];
+	_mm512_store_pd(lanes, acc);
+	for (int k = 0; k < 8; k++) {
+		s += lanes[k];
+	}
+	return s + sum_costs_scalar(h1, start1 + j, h2, start2 + j, n - j);
+}
+
+SPOT_TARGET("avx512f")
+static float sum_costs_avx512(const float* h1, int start1, const float* h2, int start2, int n) {
 	float s = 0;
-	while (start1 % 8 != 0) {
-		s += cost(h1[start1], h2[start2]);
-		start1++;
-		start2++;
+	while (start1 % 16 != 0 && n > 0) {
+		s += cost(h1[start1++], h2[start2++]);
 		n--;
 	}
-	const float* h1p = &h1[start1];
-	const float* h2p = &h2[start2];
-	__m256 s2 = _mm256_setzero_ps();
-	int j;
-	for (j = 0; j < n - 7; j += 8) {
-		__m256 hm1 = _mm256_load_ps(h1p);
-		__m256 hm2 = _mm256_loadu_ps(h2p);
-		s2 = _mm256_add_ps(s2, cost(hm1, hm2)); h1p += 8;  h2p += 8;
-	}
-	s += sum8(s2);
-	for (int k = j; k < n; k++) {
-		s += cost(*h1p, *h2p); h1p++;  h2p++;
+	__m512 acc = _mm512_setzero_ps();
+	int j = 0;
+	for (; j + 16 <= n; j += 16) {
+		const __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(h1 + start1 + j), _mm512_loadu_ps(h2 + start2 + j));
+		acc = _mm512_fmadd_ps(diff, diff, acc);
 	}
-	return s;
+	alignas(64) float lanes[16];
+	_mm512_store_ps(lanes, acc);
+	for (int k = 0; k < 16; k++) {
+		s += lanes[k];
+	}
+	return s + sum_costs_scalar(h1, start1 + j, h2, start2 + j, n - j);
+}
+
+SPOT_TARGET("avx512f")
+static int first_greater_avx512(const double* h, int start, int end, double value) {
+	const __m512d v = _mm512_set1_pd(value);
+	int j = start;
+	for (; j + 8 <= end; j += 8) {
+		const __mmask8 mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(h + j), v, _CMP_GT_OQ);
+		if (mask) return j + lowest_bit(mask);
+	}
+	return first_greater_scalar(h, j, end, value);
+}
+
+SPOT_TARGET("avx512f")
+static int first_greater_avx512(const float* h, int start, int end, float value) {
+	const __m512 v = _mm512_set1_ps(value);
+	int j = start;
+	for (; j + 16 <= end; j += 16) {
+		const __mmask16 mask = _mm512_cmp_ps_mask(_mm512_loadu_ps(h + j), v, _CMP_GT_OQ);
+		if (mask) return j + lowest_bit(mask);
+	}
+	return first_greater_scalar(h, j, end, value);
+}
+//endregion
+
+#endif // SPOT_SIMD_X86
+
+//region --- Runtime dispatch ---
+namespace {
+
+	/// @brief The variants of the SIMD kernels for one instruction set.
+	struct kernel_table {
+		double (*sum_costs_d)(const double*, int, const double*, int, int);
+		float (*sum_costs_f)(const float*, int, const float*, int, int);
+		int (*first_greater_d)(const double*, int, int, double);
+		int (*first_greater_f)(const float*, int, int, float);
+	};
+
+	const kernel_table kernels_scalar = { &sum_costs_scalar<double>, &sum_costs_scalar<float>, &first_greater_scalar<double>, &first_greater_scalar<float> };
+#if SPOT_SIMD_X86
+	const kernel_table kernels_sse42 = { &sum_costs_sse42, &sum_costs_sse42, &first_greater_sse42, &first_greater_sse42 };
+	const kernel_table kernels_avx2 = { &sum_costs_avx2, &sum_costs_avx2, &first_greater_avx2, &first_greater_avx2 };
+	const kernel_table kernels_avx512 = { &sum_costs_avx512, &sum_costs_avx512, &first_greater_avx512, &first_greater_avx512 };
+#endif
+
+	const kernel_table* kernels_for(simd::isa_level level) {
+#if SPOT_SIMD_X86
+		switch (level) {
+			case simd::isa_level::avx512: return &kernels_avx512;
+			case simd::isa_level::avx2_fma: return &kernels_avx2;
+			case simd::isa_level::sse42: return &kernels_sse42;
+			default: break;
+		}
+#endif
+		return &kernels_scalar;
+	}
+
+#if SPOT_SIMD_X86 && defined(_MSC_VER)
+	simd::isa_level detect_isa() {
+		int info[4];
+		__cpuid(info, 0);
+		const int max_leaf = info[0];
+		__cpuid(info, 1);
+		const bool sse42 = (info[2] >> 20) & 1;
+		const bool fma = (info[2] >> 12) & 1;
+		const bool osxsave = (info[2] >> 27) & 1;
+		// The OS must save the AVX (and AVX-512) registers on context switches for them to be usable :
+		const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		const bool os_avx = (xcr0 & 0x6) == 0x6;
+		const bool os_avx512 = (xcr0 & 0xe6) == 0xe6;
+		bool avx2 = false, avx512f = false;
+		if (max_leaf >= 7) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] >> 5) & 1;
+			avx512f = (info[1] >> 16) & 1;
+		}
+		if (avx512f && os_avx512) return simd::isa_level::avx512;
+		if (avx2 && fma && os_avx) return simd::isa_level::avx2_fma;
+		if (sse42) return simd::isa_level::sse42;
+		return simd::isa_level::scalar;
+	}
+#elif SPOT_SIMD_X86
+	simd::isa_level detect_isa() {
+		// Also checks the OS saves the extended registers :
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) return simd::isa_level::avx512;
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return simd::isa_level::avx2_fma;
+		if (__builtin_cpu_supports("sse4.2")) return simd::isa_level::sse42;
+		return simd::isa_level::scalar;
+	}
+#else
+	simd::isa_level detect_isa() {
+		return simd::isa_level::scalar;
+	}
+#endif
+
+	/// @brief Reads the instruction set requested in the SPOT_SIMD environment variable, if any.
+	simd::isa_level requested_isa(simd::isa_level detected) {
+		const char* requested = std::getenv("SPOT_SIMD");
+		if (requested == nullptr) return detected;
+		const std::string name(requested);
+		for (int level = 0; level <= static_cast<int>(simd::isa_level::avx512); level++) {
+			if (name == simd::isa_name(static_cast<simd::isa_level>(level))) {
+				return std::min(detected, static_cast<simd::isa_level>(level));
+			}
+		}
+		return detected;
+	}
+
+	/// @brief The instruction set detected, and the one the kernels use.
+	struct dispatch_state {
+		dispatch_state() : detected(detect_isa()), active(requested_isa(detected)), kernels(kernels_for(active)) {}
+
+		const simd::isa_level detected;
+		simd::isa_level active;
+		const kernel_table* kernels;
+	};
+
+	/// @brief Detects the instruction set on first use, so the kernels can be called during static initialization.
+	dispatch_state& dispatch() {
+		static dispatch_state state;
+		return state;
+	}
+
+} // anonymous namespace
+
+namespace simd {
+
+	isa_level detected_isa() {
+		return dispatch().detected;
+	}
+
+	isa_level active_isa() {
+		return dispatch().active;
+	}
+
+	isa_level set_active_isa(isa_level level) {
+		dispatch_state& state = dispatch();
+		state.active = std::min(level, state.detected);
+		state.kernels = kernels_for(state.active);
+		return state.active;
+	}
+
+	const char* isa_name(isa_level level) {
+		switch (level) {
+			case isa_level::avx512: return "avx512";
+			case isa_level::avx2_fma: return "avx2";
+			case isa_level::sse42: return "sse4.2";
+			default: return "scalar";
+		}
+	}
+
+} // namespace simd
+//endregion
+
+// sum the cost of consecutively matching the first n values in h1 starting from start1 to the first n consecutive values of h2 starting at start2
+// uses the widest SIMD instructions available : supposes h1 is aligned to 256 bits ; h2 need not be aligned
+double sumCosts(const double* h1, int start1, const double* h2, int start2, int n) {
+	if (n < 32) {
+		return sum_costs_scalar(h1, start1, h2, start2, n);
+	}
+	return dispatch().kernels->sum_costs_d(h1, start1, h2, start2, n);
+}
+
+float sumCosts(const float* h1, int start1, const float* h2, int start2, int n) {
+	if (n < 32) {
+		return sum_costs_scalar(h1, start1, h2, start2, n);
+	}
+	return dispatch().kernels->sum_costs_f(h1, start1, h2, start2, n);
+}
+
+// first index j in [start, end) such that h[j] > value, or end if there is none. h is sorted.
+// merge-style linear search, with the widest SIMD comparisons available : meant for results close to start
+int first_greater(const double* h, int start, int end, double value) {
+	return dispatch().kernels->first_greater_d(h, start, end, value);
+}
+
+int first_greater(const float* h, int start, int end, float value) {
+	return dispatch().kernels->first_greater_f(h, start, end, value);
 }
 
 void * malloc_simd(const size_t size, const size_t alignment) {
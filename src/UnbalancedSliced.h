@@ -39,11 +39,15 @@
 #include <ctime>
 #include <cstring>
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 #include <omp.h>
 #include <list>
-#include <thread>
 #include <random>
+#include <memory>
 #include "Point.h"
+#include "PointCloud.h"
 
 // CLANG complains about some varargs macros in CImg, ignore it :
 #pragma clang diagnostic push
@@ -52,13 +56,11 @@
 #include "../external/CImg.h"
 #pragma clang diagnostic pop
 
-#ifdef _MSC_VER
-  #include <intrin.h>
-#else
-  #include <immintrin.h>
-  #if __linux__
-    #include <malloc.h>
-  #endif
+#include "sse_helpers.h"
+#include "cost_policies.h"
+#include "radix_sort.h"
+#if !defined(_MSC_VER) && __linux__
+  #include <malloc.h>
 #endif
 
 
@@ -66,12 +68,36 @@
 #define M_PI 3.14159265358979323856
 #endif
 
-float cost(float x, float y);
-double cost(double x, double y);
-__m256 cost(const __m256 &x, const __m256 &y);
-__m256d cost(const __m256d &x, const __m256d &y);
-double sumCosts(const double* h1, int start1, const double* h2, int start2, int n);
-float sumCosts(const float* h1, int start1, const float* h2, int start2, int n);
+/// @brief Finds the first sample of the sorted range [start, end) of h which is strictly greater than value, by exponential search.
+/// @details Probes h[start + 1], h[start + 2], h[start + 4], ... then binary-searches the last interval. Runs in
+/// O(log(distance to the result)), which is better than a linear scan when the result can be far from start.
+/// @returns The index of the first sample greater than value, or end if there is none.
+template<typename T>
+int first_greater_galloping(const T* h, int start, int end, T value) {
+	if (start >= end || h[start] > value) {
+		return start;
+	}
+	// Invariant : h[low] <= value.
+	int low = start;
+	int step = 1;
+	while (low + step < end && h[low + step] <= value) {
+		low += step;
+		step <<= 1;
+	}
+	// Branch-free binary search of the first sample greater than value in (low, high] :
+	const T* first = h + low + 1;
+	int length = std::min(low + step, end) - (low + 1);
+	while (length > 1) {
+		const int half = length / 2;
+		first += (first[half - 1] <= value) ? half : 0;
+		length -= half;
+	}
+	first += (length == 1 && *first <= value) ? 1 : 0;
+	return static_cast<int>(first - h);
+}
+
+int first_greater(const double* h, int start, int end, double value);
+int first_greater(const float* h, int start, int end, float value);
 void * malloc_simd(const size_t size, const size_t alignment);
 void free_simd(void* mem);
 
@@ -91,6 +117,244 @@ struct params {
 	int end1; ///< End of a series of contiguous pairings, in the target distribution.
 };
 
+/// @brief Scratch buffers used by a single thread of the 1D solver, in linear_time_decomposition() and simple_solve().
+/// @details The buffers only ever grow : once they have reached the size of the largest sub-problem seen, calls to
+/// prepare() do not allocate anymore.
+/// @tparam T The data type of the samples to match.
+template<typename T>
+struct TransportScratch {
+	/// @brief Resets the buffers for a sub-problem spanning N samples of the target distribution.
+	/// @param N The number of samples of the target distribution in the sub-problem.
+	/// @param with_costs If true, also resets the cost buffers (only used by simple_solve()).
+	void prepare(int N, bool with_costs) {
+		taken.assign(N, -1);
+		ninj.assign(N, 0);
+		prev_free.resize(N);
+		next_free.resize(N);
+		if (with_costs) {
+			cost_dontMove.assign(N, 0);
+			cost_moveLeft.assign(N, 0);
+		}
+	}
+
+	std::vector<int> taken; ///< Index of the source sample taking each target sample, or -1 if free.
+	std::vector<int> ninj; ///< Number of source samples whose nearest neighbor is each target sample.
+	std::vector<int> prev_free; ///< Previous free target sample, for each target sample.
+	std::vector<int> next_free; ///< Next free target sample, for each target sample.
+	std::vector<T> cost_dontMove; ///< Cost of the current block if it is extended to the right.
+	std::vector<T> cost_moveLeft; ///< Cost of the current block if it is shifted to the left.
+	micro_benchmarks::TransportStats stats; ///< The paths taken by the sub-problems this thread solved, merged after each call.
+};
+
+/// @brief How the directions of the slices are drawn (see DirectionGenerator).
+enum class DirectionSampling {
+	gaussian, ///< Independent directions, uniformly distributed on the sphere : random_direction().
+	orthogonal_frames, ///< Blocks of DIM mutually orthogonal directions, each block being a uniformly random rotation.
+	low_discrepancy ///< A deterministic set covering the half-sphere evenly, for a known number of directions.
+};
+
+/// @brief The sorted projections of a fixed target cloud on the slices of UnbalancedSliced::correspondencesNd().
+/// @details correspondencesNd() draws the same directions on every call : the sorted projections of a target which does
+/// not move (as in FIST) can be computed once per slice, and shared by all the registrations against that target. The
+/// cache is tied to one cloud (its address and size) and one series of directions (their sampling and number, on which
+/// low-discrepancy directions depend) : it is cleared when used with others, but cannot detect a cloud modified in place. At most max_bytes of projections are kept : the slices beyond are projected and sorted every time.
+/// A cache must not be used by two calls at the same time.
+/// @tparam T The data type of the samples.
+template<typename T>
+struct SortedProjectionCache {
+	/// @brief Returns the cached projections of the n samples of cloud on slice, sorted, or nullptr if they are not cached.
+	/// @param sampling How the directions of the slices are drawn.
+	/// @param count The number of slices of the series the directions are drawn for.
+	const T* find(const void* cloud, int n, DirectionSampling sampling, int count, int slice) {
+		if (cloud != this->cloud || n != this->size || sampling != this->sampling || count != this->count) {
+			this->slices.clear();
+			this->bytes = 0;
+			this->cloud = cloud;
+			this->size = n;
+			this->sampling = sampling;
+			this->count = count;
+		}
+		if (slice >= static_cast<int>(this->slices.size()) || this->slices[slice].empty()) {
+			return nullptr;
+		}
+		return this->slices[slice].data();
+	}
+
+	/// @brief Caches the sorted projections of the samples of the cloud last passed to find() on slice, if there is room.
+	void store(int slice, const T* sorted) {
+		const std::size_t slice_bytes = static_cast<std::size_t>(this->size) * sizeof(T);
+		if (this->size == 0 || this->bytes + slice_bytes > this->max_bytes) {
+			return;
+		}
+		if (slice >= static_cast<int>(this->slices.size())) {
+			this->slices.resize(slice + 1);
+		}
+		this->slices[slice].assign(sorted, sorted + this->size);
+		this->bytes += slice_bytes;
+	}
+
+	std::vector<std::vector<T> > slices; ///< The sorted projections of each slice, empty if not cached.
+	const void* cloud = nullptr; ///< The cloud whose projections are cached.
+	int size = 0; ///< The number of samples of that cloud.
+	DirectionSampling sampling = DirectionSampling::gaussian; ///< How the directions of the slices are drawn.
+	int count = 0; ///< The number of slices of the series the directions are drawn for.
+	std::size_t max_bytes = std::size_t(512) << 20; ///< Memory cap of the projections.
+	std::size_t bytes = 0; ///< Memory used by the projections.
+};
+
+/// @brief A growable array aligned as by malloc_simd(), for the distributions handed to the 1D solver.
+/// @details Move-only. Like the scratch buffers, it only ever grows, and its contents are lost when it does.
+/// @tparam T The data type of the samples.
+template<typename T>
+struct SimdBuffer {
+	SimdBuffer() = default;
+	SimdBuffer(const SimdBuffer&) = delete;
+	SimdBuffer& operator=(const SimdBuffer&) = delete;
+	SimdBuffer(SimdBuffer&& other) noexcept : data(other.data), capacity(other.capacity) {
+		other.data = nullptr;
+		other.capacity = 0;
+	}
+	SimdBuffer& operator=(SimdBuffer&& other) noexcept {
+		std::swap(this->data, other.data);
+		std::swap(this->capacity, other.capacity);
+		return *this;
+	}
+	~SimdBuffer() {
+		if (this->data) {
+			free_simd(this->data);
+		}
+	}
+
+	/// @brief Makes room for n samples, and returns the array.
+	T* reserve(std::size_t n) {
+		if (n > this->capacity) {
+			if (this->data) {
+				free_simd(this->data);
+			}
+			this->data = static_cast<T*>(malloc_simd(n * sizeof(T), 32));
+			this->capacity = n;
+		}
+		return this->data;
+	}
+
+	T* data = nullptr; ///< The aligned array, or nullptr if nothing was reserved yet.
+	std::size_t capacity = 0; ///< The number of samples the array can hold.
+};
+
+template<typename T>
+struct TransportBatchWorkspace;
+
+/// @brief Caller-owned buffers for UnbalancedSliced::transport1d(), to be reused across slices.
+/// @details After a few calls (once sized for the largest M/N seen), transport1d() does not perform heap allocations
+/// anymore. A workspace must not be used by two calls to transport1d() at the same time.
+/// @tparam T The data type of the samples to match.
+template<typename T>
+struct TransportWorkspace {
+	TransportWorkspace() = default;
+	/// @brief Pre-allocates the workspace for source distributions of M samples and target distributions of N samples.
+	TransportWorkspace(int M, int N) { this->reserve(M, N); }
+
+	/// @brief Pre-allocates the workspace for source distributions of M samples and target distributions of N samples.
+	/// @details Only the buffers of the sequential part of transport1d() are fully allocated. Per-thread buffers grow
+	/// as needed, to the size of the largest sub-problem each thread has seen.
+	void reserve(int M, int N) {
+		this->nearest_neighbor_assignment.reserve(M);
+		this->splits.reserve(M);
+		this->todo.reserve(M);
+		this->ensure_threads(omp_get_max_threads());
+		this->scratch[0].prepare(N, false);
+	}
+
+	/// @brief Makes sure there is one set of scratch buffers for each of the nthreads threads of the todo loop.
+	void ensure_threads(int nthreads) {
+		if (static_cast<int>(this->scratch.size()) < nthreads) {
+			this->scratch.resize(nthreads);
+		}
+	}
+
+	std::vector<int> nearest_neighbor_assignment; ///< The nearest-neighbor assignment of the current slice.
+	std::vector<params> splits; ///< The sub-problems found by linear_time_decomposition().
+	std::vector<params> todo; ///< The sub-problems left to solve in parallel.
+	std::vector<T> partial_costs; ///< The cost of each sub-problem in todo, summed in order once they are all solved.
+	std::vector<T> partial_bounds; ///< The extra cost bound of each sub-problem in todo, in UnbalancedSliced::approximate_transport1d().
+	std::vector<TransportScratch<T>> scratch; ///< One set of scratch buffers per thread. The sequential part uses the first one.
+	std::vector<int> chunk_bounds; ///< The chunks of source samples of UnbalancedSliced::parallel_linear_time_decomposition().
+	std::vector<std::vector<params>> chunk_splits; ///< The sub-problems of each chunk.
+	std::vector<char> chunk_dirty; ///< Whether each chunk must be decomposed (again).
+	RadixSortWorkspace<T> sort; ///< The buffers of the sorts of UnbalancedSliced::correspondencesNd().
+	CountingSortWorkspace key_sort; ///< The buffers of the sorts of 16-bit keys of UnbalancedSliced::correspondencesNd().
+	WarmSortCache sorted_order1; ///< The permutation sorting cloud1 on each slice of UnbalancedSliced::correspondencesNd().
+	WarmSortCache sorted_order2; ///< The permutation sorting cloud2 on each slice of UnbalancedSliced::correspondencesNd().
+	SortedProjectionCache<T>* target_projections = nullptr; ///< If non-null, the sorted projections of cloud2 in UnbalancedSliced::correspondencesNd().
+	std::unique_ptr<TransportBatchWorkspace<T>> batch; ///< The buffers of the slices correspondencesNd() solves in batches, created on first use.
+	micro_benchmarks::TransportStats stats; ///< The paths taken by the slices solved with this workspace, if enabled at compile time.
+};
+
+/// @brief Caller-owned buffers for UnbalancedSliced::transport1d_batch(), to be reused across batches.
+/// @tparam T The data type of the samples to match.
+template<typename T>
+struct TransportBatchWorkspace {
+	/// @brief Makes sure there is one workspace per slice for K slices, and scratch buffers for nthreads threads.
+	void ensure(int K, int nthreads) {
+		if (static_cast<int>(this->slices.size()) < K) {
+			this->slices.resize(K);
+		}
+		if (static_cast<int>(this->scratch.size()) < nthreads) {
+			this->scratch.resize(nthreads);
+		}
+	}
+
+	std::vector<TransportWorkspace<T>> slices; ///< The workspace of each slice : nearest neighbors, splits and sub-problems.
+	std::vector<char> solved; ///< Whether each slice was entirely solved by its front end.
+	std::vector<std::pair<int, int>> tasks; ///< The (slice, sub-problem) pairs left to solve in parallel.
+	std::vector<T> partial_costs; ///< The cost of each task, summed in order once they are all solved.
+	std::vector<TransportScratch<T>> scratch; ///< One set of scratch buffers per thread, for the sub-problems.
+	micro_benchmarks::TransportStats stats; ///< The paths taken by the slices solved with this workspace, if enabled at compile time.
+
+	// The buffers of UnbalancedSliced::batched_sliced_distance(), kept across calls :
+	std::vector<std::vector<T>> projections1; ///< The projections of cloud1 on each slice of the batch.
+	std::vector<std::vector<T>> projections2; ///< The projections of cloud2 on each slice of the batch.
+	std::vector<SimdBuffer<T>> sorted1; ///< The sorted projections of cloud1 on each slice of the batch.
+	std::vector<SimdBuffer<T>> sorted2; ///< The sorted projections of cloud2 on each slice of the batch.
+	std::vector<std::vector<int>> orders; ///< The sorting permutation of each thread.
+	std::vector<RadixSortWorkspace<T>> sorts; ///< The sort buffers of each thread.
+	std::vector<std::vector<int>> assignments; ///< The assignment of each slice of the batch.
+	std::vector<T> emds; ///< The cost of each slice of the batch.
+};
+
+/// @brief Mass moved from one source sample to one target sample, in the plan of UnbalancedSliced::weighted_transport1d().
+/// @tparam T The data type of the masses.
+template<typename T>
+struct TransportPlanEntry {
+	int source; ///< Index of the source sample, in the sorted source distribution.
+	int target; ///< Index of the target sample, in the sorted target distribution.
+	T mass; ///< The mass moved from source to target.
+};
+
+/// @brief A run of source samples matched in order to a contiguous range of target mass, in UnbalancedSliced::weighted_transport1d().
+struct WeightedRun {
+	int first; ///< The first source sample of the run, among the samples of non-zero mass.
+	double start; ///< Where the run starts in the target distribution, in cumulative target mass.
+	double rate; ///< The change of cost at the target boundaries inside the run, per unit of mass it shifts to the left.
+};
+
+/// @brief Caller-owned buffers for UnbalancedSliced::weighted_transport1d(), to be reused across slices.
+/// @details The samples of non-zero mass are kept with their cumulative masses : the buffers hold O(M0 + N0) values,
+/// whatever the masses. A workspace must not be used by two calls at the same time.
+/// @tparam T The data type of the samples to match.
+template<typename T>
+struct WeightedTransportWorkspace {
+	std::vector<int> sources; ///< The index of each source sample of non-zero mass.
+	std::vector<int> targets; ///< The index of each target sample of non-zero mass.
+	std::vector<T> source_positions; ///< The position of each of those source samples.
+	std::vector<T> target_positions; ///< The position of each of those target samples.
+	std::vector<double> source_bounds; ///< The cumulative source mass : sources[q] spans [source_bounds[q], source_bounds[q + 1]).
+	std::vector<double> target_bounds; ///< The cumulative target mass : targets[j] spans [target_bounds[j], target_bounds[j + 1]).
+	std::vector<WeightedRun> runs; ///< The runs of the plan, in increasing order.
+	std::vector<int> crossed; ///< The source sample at each target boundary inside a run.
+	std::vector<std::pair<double, int>> crossings; ///< Heap of the offset at which each of those boundaries reaches the next source.
+};
+
 
 #ifdef __APPLE__
 static std::default_random_engine engine(10); // 10 = random seed
@@ -112,6 +376,164 @@ Point<2, T> BoxMuller() {
 	return p;
 }
 
+/// @brief Draws a random direction, uniformly distributed on the unit sphere of dimension DIM.
+/// @tparam DIM The dimensionality of the direction.
+/// @tparam T The internal data type of the direction.
+template<int DIM, typename T>
+Point<DIM, T> random_direction() {
+	Point<DIM, T> dir;
+	// BoxMuller returns a random 2D point, and its coordinates are copied into the direction's fields. It is then normalized.
+	double n = 0;
+	for (int i = 0; i < DIM; i+=2) {
+		Point<2, double> randGauss = BoxMuller<double>();
+		dir[i] = randGauss[0];
+		n += dir[i] * dir[i];
+		if (i < DIM-1) {
+			dir[i+1] = randGauss[1];
+			n += dir[i+1] * dir[i+1];
+		}
+	}
+	n = std::sqrt(n);
+	for (int i = 0; i < DIM; i++) {
+		dir[i] /= n;
+	}
+	return dir;
+}
+
+/// @brief Inverse of the cumulative distribution function of the standard normal distribution, for p in (0, 1).
+/// @details Rational approximation of P. J. Acklam, with a relative error below 1.2e-9.
+inline double inverse_normal_cdf(double p) {
+	static const double a[6] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+	static const double b[5] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+	static const double c[6] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+	static const double d[4] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00};
+	const double p_low = 0.02425;
+	if (p < p_low) {
+		const double q = std::sqrt(-2 * std::log(p));
+		return (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+	}
+	if (p > 1 - p_low) {
+		const double q = std::sqrt(-2 * std::log(1 - p));
+		return -(((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+	}
+	const double q = p - 0.5;
+	const double r = q * q;
+	return (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q / (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
+}
+
+/// @brief Draws the directions of a series of slices.
+/// @details A direction and its opposite make the same slice, so low-discrepancy sets cover a half-sphere : equispaced
+/// angles in 2D, a spherical Fibonacci lattice in 3D, and in higher dimensions the R_d Kronecker sequence of Roberts
+/// mapped to the sphere through the inverse normal distribution. Random samplings draw from the seeded engine, like
+/// random_direction().
+/// @tparam DIM The dimensionality of the directions.
+/// @tparam T The internal data type of the directions.
+template<int DIM, typename T>
+class DirectionGenerator {
+public:
+	/// @brief Prepares the series of count directions.
+	DirectionGenerator(DirectionSampling sampling, int count) : sampling(sampling), count(std::max(count, 1)) {}
+
+	/// @brief Returns the next direction of the series.
+	Point<DIM, T> next() {
+		const int k = this->index++;
+		switch (this->sampling) {
+			case DirectionSampling::orthogonal_frames:
+				if (k % DIM == 0) {
+					this->draw_frame();
+				}
+				return this->frame[k % DIM];
+			case DirectionSampling::low_discrepancy:
+				return low_discrepancy_direction(k);
+			default:
+				return random_direction<DIM, T>();
+		}
+	}
+
+private:
+	/// @brief Orthonormalizes DIM random directions (modified Gram-Schmidt), redrawing the rare degenerate ones.
+	void draw_frame() {
+		for (int i = 0; i < DIM; i++) {
+			double n = 0;
+			do {
+				this->frame[i] = random_direction<DIM, T>();
+				for (int j = 0; j < i; j++) {
+					double dot = 0;
+					for (int c = 0; c < DIM; c++) {
+						dot += this->frame[i][c] * this->frame[j][c];
+					}
+					for (int c = 0; c < DIM; c++) {
+						this->frame[i][c] -= dot * this->frame[j][c];
+					}
+				}
+				n = 0;
+				for (int c = 0; c < DIM; c++) {
+					n += this->frame[i][c] * this->frame[i][c];
+				}
+				n = std::sqrt(n);
+			} while (n < 1e-6);
+			for (int c = 0; c < DIM; c++) {
+				this->frame[i][c] /= n;
+			}
+		}
+	}
+
+	Point<DIM, T> low_discrepancy_direction(int k) const {
+		Point<DIM, T> dir;
+		const double t = (k % this->count + 0.5) / this->count;
+		if (DIM == 1) {
+			dir[0] = 1;
+		} else if (DIM == 2) {
+			dir[0] = std::cos(t * M_PI);
+			dir[1] = std::sin(t * M_PI);
+		} else if (DIM == 3) {
+			const double golden_angle = M_PI * (3 - std::sqrt(5.));
+			const double z = 1 - t;
+			const double r = std::sqrt(std::max(0., 1 - z * z));
+			dir[0] = r * std::cos(golden_angle * k);
+			dir[1] = r * std::sin(golden_angle * k);
+			dir[2] = z;
+		} else {
+			// phi is the unique positive root of x^(DIM+1) = x + 1 :
+			double phi = 2;
+			for (int i = 0; i < 32; i++) {
+				phi = std::pow(1 + phi, 1. / (DIM + 1));
+			}
+			double n = 0, alpha = 1;
+			for (int c = 0; c < DIM; c++) {
+				alpha /= phi;
+				double u = 0.5 + alpha * (k + 1);
+				u -= std::floor(u);
+				dir[c] = inverse_normal_cdf(std::min(std::max(u, 1e-12), 1 - 1e-12));
+				n += dir[c] * dir[c];
+			}
+			n = std::sqrt(n);
+			for (int c = 0; c < DIM; c++) {
+				dir[c] /= n;
+			}
+		}
+		return dir;
+	}
+
+	DirectionSampling sampling; ///< How the directions are drawn.
+	int count; ///< The number of directions of the series, for the low-discrepancy sets.
+	int index = 0; ///< The index of the next direction.
+	Point<DIM, T> frame[DIM]; ///< The current block of orthogonal_frames.
+};
+
+/// @brief A cloud advected without being copied : each sample is the one of a fixed cloud plus a displacement.
+/// @details correspondencesNd() projects base + displacement, and accumulates the advection into displacement only.
+/// @tparam DIM The dimensionality of the samples.
+/// @tparam T The internal data type of the samples.
+template<int DIM, typename T>
+struct DisplacedCloud {
+	const PointCloud<DIM, T> &base; ///< The samples before the advection.
+	PointCloud<DIM, T> &displacement; ///< The displacement of each sample of base.
+
+	/// @brief Returns the number of samples.
+	std::size_t size() const { return this->base.size(); }
+};
+
 /// @brief Handles the projection of n-dimensional samples onto a one-dimensional line.
 /// @tparam DIM The dimensionality of the samples to project.
 /// @tparam T The internal type of the samples to project.
@@ -131,39 +553,555 @@ struct Projector {
 		return proj;
 	}
 
+	/// @brief Writes the projections of the samples of cloud into out.
+	void project(const std::vector<Point<DIM, T> > &cloud, T* out) {
+		for (int i = 0; i < cloud.size(); i++) {
+			out[i] = proj(cloud[i]);
+		}
+	}
+
+	/// @brief Writes the projections of the samples of cloud into out, with the same rounding as proj().
+	/// @details The coordinates are read with unit stride, so that the loop is vectorized.
+	void project(const PointCloud<DIM, T> &cloud, T* out) {
+		const T* coords[DIM];
+		for (int c = 0; c < DIM; c++) {
+			coords[c] = cloud.coord(c);
+		}
+		const int n = static_cast<int>(cloud.size());
+	#pragma omp simd
+		for (int i = 0; i < n; i++) {
+			double proj = 0;
+			for (int c = 0; c < DIM; c++) {
+				proj += coords[c][i] * dir[c];
+			}
+			out[i] = proj;
+		}
+	}
+
+	/// @brief Writes the projections of the displaced samples of cloud into out, without storing them.
+	void project(const DisplacedCloud<DIM, T> &cloud, T* out) {
+		const T* coords[DIM];
+		const T* deltas[DIM];
+		for (int c = 0; c < DIM; c++) {
+			coords[c] = cloud.base.coord(c);
+			deltas[c] = cloud.displacement.coord(c);
+		}
+		const int n = static_cast<int>(cloud.size());
+	#pragma omp simd
+		for (int i = 0; i < n; i++) {
+			double proj = 0;
+			for (int c = 0; c < DIM; c++) {
+				proj += static_cast<T>(coords[c][i] + deltas[c][i]) * dir[c];
+			}
+			out[i] = proj;
+		}
+	}
+
 	const Point<DIM, T> dir; ///< The 1D-line to project samples onto.
 };
 
+/// @brief Moves each sample of cloud along dir, the i-th one by delta[i] * dir.
+template<int DIM, typename T>
+void displace_samples(std::vector<Point<DIM, T> > &cloud, const T* delta, const Point<DIM, T> &dir) {
+	for (int i = 0; i < cloud.size(); i++) {
+		for (int j = 0; j < DIM; j++) {
+			cloud[i][j] += delta[i] * dir[j];
+		}
+	}
+}
+
+/// @brief Moves each sample of cloud along dir, the i-th one by delta[i] * dir.
+/// @details Each coordinate array is updated with unit stride, so that the loops are vectorized.
+template<int DIM, typename T>
+void displace_samples(PointCloud<DIM, T> &cloud, const T* delta, const Point<DIM, T> &dir) {
+	const int n = static_cast<int>(cloud.size());
+	for (int j = 0; j < DIM; j++) {
+		T* x = cloud.coord(j);
+		const T d = dir[j];
+	#pragma omp simd
+		for (int i = 0; i < n; i++) {
+			x[i] += delta[i] * d;
+		}
+	}
+}
+
+/// @brief Moves each sample of cloud along dir, the i-th one by delta[i] * dir : only its displacement is updated.
+template<int DIM, typename T>
+void displace_samples(DisplacedCloud<DIM, T> &cloud, const T* delta, const Point<DIM, T> &dir) {
+	displace_samples(cloud.displacement, delta, dir);
+}
+
+/// @brief Projects samples onto several directions in one pass : the (samples x DIM) by (DIM x directions) product.
+/// @details Samples are transposed by blocks of batch_block, which fit in L1 with their projections : the products are
+/// then contiguous multiply-adds across samples, vectorized by the compiler, and each direction's projections are written
+/// straight to its own buffer. Unlike Projector, sums are accumulated in T : float samples have float projections.
+/// @tparam DIM The dimensionality of the samples to project.
+/// @tparam T The internal type of the samples to project.
+template<int DIM, typename T>
+struct BatchProjector {
+	/// @brief The number of samples transposed at once.
+	static constexpr int batch_block = 256;
+
+	/// @brief Prepares the projection onto the K directions dirs.
+	BatchProjector(const Point<DIM, T>* dirs, int K) : dirs(dirs), K(K) {}
+
+	/// @brief Writes the projection of points[i] onto the k-th direction into out[k][i], for the n first points.
+	/// @details Runs in parallel on large clouds, when not already inside a parallel region.
+	void project(const Point<DIM, T>* points, int n, T* const* out) const {
+		const int blocks = (n + batch_block - 1) / batch_block;
+	#pragma omp parallel for schedule(static) if(blocks >= 64 && !omp_in_parallel())
+		for (int block = 0; block < blocks; block++) {
+			const int first = block * batch_block;
+			const int size = std::min(batch_block, n - first);
+			T transposed[DIM][batch_block];
+			for (int i = 0; i < size; i++) {
+				for (int c = 0; c < DIM; c++) {
+					transposed[c][i] = points[first + i][c];
+				}
+			}
+			for (int k = 0; k < this->K; k++) {
+				T* dst = out[k] + first;
+				const T d0 = this->dirs[k][0];
+				for (int i = 0; i < size; i++) {
+					dst[i] = transposed[0][i] * d0;
+				}
+				for (int c = 1; c < DIM; c++) {
+					const T dc = this->dirs[k][c];
+					const T* src = transposed[c];
+					for (int i = 0; i < size; i++) {
+						dst[i] += src[i] * dc;
+					}
+				}
+			}
+		}
+	}
+
+	/// @brief Writes the projection of cloud[i] onto the k-th direction into out[k][i].
+	void project(const std::vector<Point<DIM, T> >& cloud, T* const* out) const {
+		this->project(cloud.data(), static_cast<int>(cloud.size()), out);
+	}
+
+	/// @brief Writes the projection of the i-th sample of cloud onto the k-th direction into out[k][i].
+	/// @details The samples are already stored by coordinate : the blocks are not transposed.
+	void project(const PointCloud<DIM, T>& cloud, T* const* out) const {
+		const int n = static_cast<int>(cloud.size());
+		const int blocks = (n + batch_block - 1) / batch_block;
+	#pragma omp parallel for schedule(static) if(blocks >= 64 && !omp_in_parallel())
+		for (int block = 0; block < blocks; block++) {
+			const int first = block * batch_block;
+			const int size = std::min(batch_block, n - first);
+			for (int k = 0; k < this->K; k++) {
+				T* dst = out[k] + first;
+				const T* src = cloud.coord(0) + first;
+				const T d0 = this->dirs[k][0];
+				for (int i = 0; i < size; i++) {
+					dst[i] = src[i] * d0;
+				}
+				for (int c = 1; c < DIM; c++) {
+					const T dc = this->dirs[k][c];
+					src = cloud.coord(c) + first;
+					for (int i = 0; i < size; i++) {
+						dst[i] += src[i] * dc;
+					}
+				}
+			}
+		}
+	}
+
+	/// @brief Writes the projection of the i-th displaced sample of cloud onto the k-th direction into out[k][i].
+	/// @details Each block of samples is displaced once, in L1, for all the directions.
+	void project(const DisplacedCloud<DIM, T>& cloud, T* const* out) const {
+		const int n = static_cast<int>(cloud.size());
+		const int blocks = (n + batch_block - 1) / batch_block;
+	#pragma omp parallel for schedule(static) if(blocks >= 64 && !omp_in_parallel())
+		for (int block = 0; block < blocks; block++) {
+			const int first = block * batch_block;
+			const int size = std::min(batch_block, n - first);
+			T displaced[DIM][batch_block];
+			for (int c = 0; c < DIM; c++) {
+				const T* x = cloud.base.coord(c) + first;
+				const T* d = cloud.displacement.coord(c) + first;
+				for (int i = 0; i < size; i++) {
+					displaced[c][i] = x[i] + d[i];
+				}
+			}
+			for (int k = 0; k < this->K; k++) {
+				T* dst = out[k] + first;
+				const T d0 = this->dirs[k][0];
+				for (int i = 0; i < size; i++) {
+					dst[i] = displaced[0][i] * d0;
+				}
+				for (int c = 1; c < DIM; c++) {
+					const T dc = this->dirs[k][c];
+					const T* src = displaced[c];
+					for (int i = 0; i < size; i++) {
+						dst[i] += src[i] * dc;
+					}
+				}
+			}
+		}
+	}
+
+	const Point<DIM, T>* dirs; ///< The directions to project onto.
+	const int K; ///< The number of directions.
+};
+
+/// @brief Precision of the projections sorted and matched by correspondencesNd().
+enum class ProjectionKeys {
+	full,       ///< Projections are stored and sorted in the samples' own type.
+	quantized16 ///< Projections are quantized to 16-bit keys, see KeyQuantizer.
+};
+
+/// @brief Settings of UnbalancedSliced::approximate_transport1d() : its accuracy/speed trade-off.
+/// @details Only the sub-problems of more than max(2 * refine + 2, 4 * grid) source samples are approximated : larger values
+/// of both settings get closer to the exact solver, and are slower.
+struct QuantileApproximation {
+	int grid = 32; ///< Resolution of the grid of source quantiles the matching is fitted on : 4 * grid quantiles.
+	int refine = 32; ///< Number of source samples at each end of an approximated sub-problem re-solved exactly. 0 disables the refinement.
+	double extra_cost_bound = 0; ///< Set by correspondencesNd() : bound on the extra sliced distance versus the exact solver.
+};
+
+/// @brief Axis-aligned bounding box of point clouds, used to bound the range of their projections.
+template<int DIM, typename T>
+struct BoundingBox {
+	BoundingBox() {
+		for (int j = 0; j < DIM; j++) {
+			lo[j] = std::numeric_limits<T>::max();
+			hi[j] = std::numeric_limits<T>::lowest();
+		}
+	}
+
+	/// @brief Grows the box to contain p.
+	void add(const Point<DIM, T> &p) {
+		for (int j = 0; j < DIM; j++) {
+			lo[j] = std::min(lo[j], p[j]);
+			hi[j] = std::max(hi[j], p[j]);
+		}
+	}
+
+	/// @brief Grows the box to contain all samples of cloud.
+	void add(const std::vector<Point<DIM, T> > &cloud) {
+		for (int i = 0; i < cloud.size(); i++) {
+			add(cloud[i]);
+		}
+	}
+
+	/// @brief Grows the box to contain another one, which may be empty.
+	void add(const BoundingBox &other) {
+		for (int j = 0; j < DIM; j++) {
+			lo[j] = std::min(lo[j], other.lo[j]);
+			hi[j] = std::max(hi[j], other.hi[j]);
+		}
+	}
+
+	/// @brief Computes the range [plo, phi] of the projections of the box on the direction dir.
+	void projection_range(const Point<DIM, T> &dir, double &plo, double &phi) const {
+		plo = 0;
+		phi = 0;
+		for (int j = 0; j < DIM; j++) {
+			plo += std::min(dir[j] * lo[j], dir[j] * hi[j]);
+			phi += std::max(dir[j] * lo[j], dir[j] * hi[j]);
+		}
+	}
+
+	/// @brief Returns the length of the diagonal of the box : no projection range on a unit direction is larger.
+	double diagonal() const {
+		double d = 0;
+		for (int j = 0; j < DIM; j++) {
+			d += (double(hi[j]) - lo[j]) * (double(hi[j]) - lo[j]);
+		}
+		return std::sqrt(d);
+	}
+
+	Point<DIM, T> lo; ///< Lowest coordinates of the samples added.
+	Point<DIM, T> hi; ///< Highest coordinates of the samples added.
+};
+
+/// @brief Quantizes the projections of one slice to 16-bit keys, uniformly over a range [lo, hi] containing them all.
+/// @details Sorting keys instead of (projection, index) pairs moves a quarter of the memory, and takes linear time with
+/// counting_sort(). The rounding is monotonic, so sorted keys stay sorted : the 1D solver runs on dequantized keys, whose
+/// distance to the original projections is at most max_error().
+template<typename T>
+struct KeyQuantizer {
+	static constexpr int levels = 65536; ///< Number of distinct keys.
+
+	KeyQuantizer(double lo, double hi) : lo(lo), step((hi - lo) / (levels - 1)), inv_step(hi > lo ? (levels - 1) / (hi - lo) : 0.) {}
+
+	/// @brief Returns the key of the projection x, which must be in [lo, hi].
+	uint16_t quantize(double x) const {
+		const double q = (x - lo) * inv_step + 0.5;
+		return static_cast<uint16_t>(std::min(std::max(q, 0.), double(levels - 1)));
+	}
+
+	/// @brief Returns the projection represented by the given key.
+	T dequantize(uint16_t key) const {
+		return static_cast<T>(lo + key * step);
+	}
+
+	/// @brief Returns the largest distance between a projection in [lo, hi] and its dequantized key.
+	double max_error() const {
+		return step / 2;
+	}
+
+	double lo;       ///< Projection represented by key 0.
+	double step;     ///< Distance between the projections represented by two consecutive keys.
+	double inv_step; ///< 1 / step, or 0 for an empty range.
+};
+
+/// @brief Bounds the error on the projections when correspondencesNd() uses ProjectionKeys::quantized16.
+/// @details Every dequantized key is within this distance of its projection, on any slice drawn while the clouds stay in
+/// their current bounding box. Each 1D displacement is thus off by at most twice this bound, and so is the root mean
+/// matching distance of each slice (triangle inequality of the partial Wasserstein distance). For 8-bit colours, the bound
+/// is below 0.004 colour levels.
+/// @returns Half the distance between two consecutive keys on the widest possible slice.
+template<int DIM, typename T>
+double quantized_key_error(const std::vector<Point<DIM, T> > &cloud1, const std::vector<Point<DIM, T> > &cloud2) {
+	BoundingBox<DIM, T> box;
+	box.add(cloud1);
+	box.add(cloud2);
+	return box.diagonal() / (2. * (KeyQuantizer<T>::levels - 1));
+}
+
+/// @brief Projects cloud on dir, quantizes the projections to keys and sorts them with counting_sort().
+/// @details The projection, quantization, sort and dequantization run in a single parallel region, split among the
+/// OpenMP threads for clouds of at least radix_sort_parallel_size samples. This is the front end of a slice of
+/// UnbalancedSliced::quantized_correspondencesNd() : the counterpart of projecting the cloud and sorting the projections
+/// with radix_sort_projections().
+/// @param cloud The samples to project.
+/// @param dir The direction of the slice.
+/// @param quantizer The quantization of the projections on the slice.
+/// @param keys Receives the key of each sample.
+/// @param sorted Receives the dequantized keys, sorted.
+/// @param order Receives the index of the sample of each sorted key.
+/// @param workspace The caller-owned buffers of the sort.
+template<int DIM, typename T>
+void sort_quantized_projections(const std::vector<Point<DIM, T> > &cloud, const Point<DIM, T> &dir, const KeyQuantizer<T> &quantizer, uint16_t* keys, T* sorted, int* order,
+								CountingSortWorkspace &workspace) {
+	const int n = static_cast<int>(cloud.size());
+	const int max_threads = n >= radix_sort_parallel_size ? omp_get_max_threads() : 1;
+	workspace.histograms.resize(static_cast<std::size_t>(max_threads) * CountingSortWorkspace::buckets);
+	workspace.totals.resize(CountingSortWorkspace::buckets);
+#pragma omp parallel num_threads(max_threads)
+	{
+		const int thread = omp_get_thread_num();
+		const int nthreads = omp_get_num_threads();
+		const int begin = static_cast<int>(static_cast<long long>(n) * thread / nthreads);
+		const int end = static_cast<int>(static_cast<long long>(n) * (thread + 1) / nthreads);
+		Projector<DIM, T> proj(dir);
+		for (int i = begin; i < end; i++) {
+			keys[i] = quantizer.quantize(proj.proj(cloud[i]));
+		}
+		counting_sort_chunk(keys, begin, end, order, workspace);
+		for (int i = begin; i < end; i++) {
+			sorted[i] = quantizer.dequantize(keys[order[i]]);
+		}
+	}
+}
+
+/// @brief Collapses the repeated samples of a cloud into weighted diracs, for UnbalancedSliced::weighted_correspondencesNd().
+/// @details Typically cuts the pixels of an image down to its distinct colors. Samples are ordered lexicographically.
+/// @param points The cloud, with repeated samples.
+/// @param unique Receives the distinct samples.
+/// @param masses Receives the number of repetitions of each distinct sample.
+/// @param index If non-null, receives the distinct sample of each sample of points, to map the result back onto them.
+template<int DIM, typename T>
+void collapse_duplicates(const std::vector<Point<DIM, T> > &points, std::vector<Point<DIM, T> > &unique, std::vector<T> &masses, std::vector<int>* index = nullptr) {
+	const auto less = [&](int a, int b) {
+		for (int j = 0; j < DIM; j++) {
+			if (points[a][j] != points[b][j]) {
+				return points[a][j] < points[b][j];
+			}
+		}
+		return false;
+	};
+	std::vector<int> order(points.size());
+	for (int i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), less);
+
+	unique.clear();
+	masses.clear();
+	if (index) {
+		index->resize(points.size());
+	}
+	for (int k = 0; k < order.size(); k++) {
+		if (k == 0 || less(order[k - 1], order[k])) {
+			unique.push_back(points[order[k]]);
+			masses.push_back(0);
+		}
+		masses.back() += 1;
+		if (index) {
+			(*index)[order[k]] = static_cast<int>(unique.size()) - 1;
+		}
+	}
+}
+
+/// @brief The iterations of UnbalancedSliced::unbalanced_barycenter() and UnbalancedSliced::weighted_unbalanced_barycenter().
+struct BarycenterTrace {
+	int iterations = 0; ///< The number of iterations performed, at most niters.
+	bool converged = false; ///< Whether the iterations stopped before niters, on UnbalancedSliced::barycenter_tolerance.
+	std::vector<double> costs; ///< The sliced cost between the barycenter and the clouds at each iteration, before it moves.
+	std::vector<double> displacements; ///< The root mean square displacement of the samples of the barycenter at each iteration.
+	std::vector<double> steps; ///< The fraction of its displacement the barycenter moved by at each iteration.
+};
+
+/// @brief Sets the number of threads of the OpenMP parallel regions the calling thread starts, until it is destroyed.
+/// @details The OpenMP team is created once and re-used by every parallel region : setting its size here, rather than in
+/// each region, also sizes the per-thread buffers taken from omp_get_max_threads(). Threads are pinned to cores by the
+/// OpenMP runtime, with OMP_PROC_BIND and OMP_PLACES.
+class ThreadCountScope {
+public:
+	/// @brief Uses threads threads, or keeps the current setting if threads is 0 or less.
+	explicit ThreadCountScope(int threads) : previous(omp_get_max_threads()), active(threads > 0) {
+		if (this->active) {
+			omp_set_num_threads(threads);
+		}
+	}
+	~ThreadCountScope() {
+		if (this->active) {
+			omp_set_num_threads(this->previous);
+		}
+	}
+	ThreadCountScope(const ThreadCountScope&) = delete;
+	ThreadCountScope& operator=(const ThreadCountScope&) = delete;
+
+private:
+	const int previous; ///< The number of threads to restore.
+	const bool active; ///< Whether the number of threads was changed.
+};
 
 /// @brief Class responsible for performing the Unbalanced Sliced Partial Optimal Transport.
 class UnbalancedSliced {
 
 public:
+	/// @brief When the target range of a problem is this many times larger than its source range, nearest_neighbor_match()
+	/// gallops through the target samples instead of scanning them.
+	static constexpr int nn_galloping_ratio = 8;
+
+	/// @brief Problems with at least this many source samples have their sequential front end (see decompose_slice())
+	/// split into chunks processed in parallel, when not already inside a parallel region.
+	static constexpr int parallel_front_end_size = 1 << 16;
+
+	/// @brief How the directions of the slices are drawn, by correspondencesNd(), sliced_distance(), the barycenters and
+	/// FIST (see DirectionGenerator). Fewer low-discrepancy or orthogonal directions may give the accuracy of more
+	/// gaussian ones.
+	DirectionSampling direction_sampling = DirectionSampling::gaussian;
+
+	/// @brief Number of threads used by correspondencesNd(), sliced_distance(), the barycenters and FIST, or 0 to keep
+	/// the OpenMP setting (OMP_NUM_THREADS). See ThreadCountScope.
+	int num_threads = 0;
+
+	/// @brief Number of slices correspondencesNd() and FIST solve at once when advecting the source (see batched_advection()).
+	/// 1 moves the source after each slice, sequentially.
+	int advection_batch = 1;
+
+	/// @brief The barycenters stop iterating once both their cost and their displacement change by at most this fraction
+	/// (see BarycenterTrace) : the cost relative to the previous iteration, the displacement relative to the first one.
+	/// 0 always runs niters iterations.
+	double barycenter_tolerance = 0;
+
+	/// @brief If true, the barycenters halve their step when their cost increases, and grow it back towards 1 otherwise.
+	/// Damps the oscillations of the samples that jump between two matches.
+	bool barycenter_adaptive_step = false;
+
+	/// @brief Memory cap of the sorted projections of the clouds unbalanced_barycenter() keeps across its iterations. The
+	/// slices beyond are projected and sorted again at each iteration.
+	std::size_t barycenter_cache_max_bytes = std::size_t(512) << 20;
+
+	/// @brief FIST stops once an iteration rotates the source by at most fist_rotation_tolerance radians, moves its center
+	/// by at most fist_translation_tolerance and scales it by a factor within fist_scaling_tolerance of 1. A tolerance of 0
+	/// is not checked : with all three at 0, FIST always runs niters iterations.
+	double fist_rotation_tolerance = 0;
+	double fist_translation_tolerance = 0; ///< @see fist_rotation_tolerance
+	double fist_scaling_tolerance = 0; ///< @see fist_rotation_tolerance
+
+	/// @brief The number of iterations the last call to fast_iterative_sliced_transport() performed.
+	int fist_iterations = 0;
+
+	/// @brief If true, each iteration of FIST computes the centers of the source before and after advection, their
+	/// covariance and the variance of the source in a single parallel pass over the samples (see fist_moments()). If
+	/// false (the default), it takes sequential passes around the exact centers, which stay accurate for clouds much
+	/// further from their first sample than their spread.
+	bool fist_fused_moments = false;
+
+	/// @brief Memory cap of the projections of a barycenter onto a group of slices, computed at once by a BatchProjector.
+	/// The sorted projections and the displacements of the barycenter along that group of slices take as much each.
+	static constexpr std::size_t batch_projection_max_bytes = std::size_t(256) << 20;
+
+	/// @brief Memory cap of the slices sliced_distance() and correspondencesNd() (without advection) solve at once, when
+	/// their batch size is not given : the projections of both clouds on each slice, sorted and not, and its assignments.
+	static constexpr std::size_t batch_slices_max_bytes = std::size_t(256) << 20;
+
+	/// @brief Number of samples of a barycenter whose displacements are summed at once by a thread.
+	static constexpr int barycenter_block = 1024;
+
 	/// @brief Computes the nearest neighbors in 1d of the two histograms.
+	/// @details Both histograms are sorted, so the samples of hist2 left of hist1[i] have a non-increasing cost : the scan
+	/// for the nearest neighbor of hist1[i] starts at the last of them, found either with a SIMD linear search or
+	/// with an exponential search when hist2 is much larger than hist1. The result is the same as a scan over all of
+	/// them, as long as the cost is non-decreasing in |x - y|. It only depends on hist1[i] : large problems are split
+	/// into chunks matched in parallel, each starting with a binary search.
 	/// @tparam T The data type of the samples to match.
 	/// @param hist1 The first distribution to match.
 	/// @param hist2 The second distribution to match.
 	/// @param p The start/end fields of the problem to nearest-neighbor-match.
 	/// @param assignment An in/out variable containing the (possibly non-injective) assignment between hist1 and hist2.
-	template<typename T>
+	template<typename T, typename Cost = SquaredCost>
 	void nearest_neighbor_match(const T *hist1, const T* hist2, const params &p, std::vector<int> &assignment) {
-		int cursor = p.start1;
-		for (int i = p.start0; i < p.end0; i++) {
-			T mind = std::numeric_limits<T>::max();
-			int minj = -1;
-			for (int j = std::max(p.start1, cursor); j < p.end1; j++) {
-				T d = cost(hist1[i], hist2[j]);
-				cursor = j - 1;
-				if (d <= mind) {
-					mind = d;
-					minj = j;
-				} else {
-					if (d > mind + std::numeric_limits<T>::epsilon()) {
-						break;
-					}
+		const int M = p.end0 - p.start0;
+		if (M < parallel_front_end_size || omp_in_parallel() || omp_get_max_threads() == 1) {
+			nearest_neighbor_match_chunk<T, Cost>(hist1, hist2, p, p.start0, p.end0, assignment);
+			return;
+		}
+	#pragma omp parallel
+		{
+			const long long nchunks = omp_get_num_threads();
+			const long long chunk = omp_get_thread_num();
+			nearest_neighbor_match_chunk<T, Cost>(hist1, hist2, p, p.start0 + static_cast<int>(M * chunk / nchunks), p.start0 + static_cast<int>(M * (chunk + 1) / nchunks), assignment);
+		}
+	}
+
+	/// @brief Computes the nearest neighbors of the samples [begin, end) of hist1, within the range of hist2 given by p.
+	/// @see nearest_neighbor_match()
+	template<typename T, typename Cost = SquaredCost>
+	void nearest_neighbor_match_chunk(const T *hist1, const T* hist2, const params &p, int begin, int end, std::vector<int> &assignment) {
+		if (begin >= end) return;
+		if (p.start1 >= p.end1) {
+			std::fill(assignment.begin() + begin, assignment.begin() + end, -1);
+			return;
+		}
+		const bool galloping = (p.end1 - p.start1) >= nn_galloping_ratio * (p.end0 - p.start0);
+		// First sample of hist2 greater than the current sample of hist1 : it only moves forward.
+		int first_right = static_cast<int>(std::upper_bound(hist2 + p.start1, hist2 + p.end1, hist1[begin]) - hist2);
+		for (int i = begin; i < end; i++) {
+			// In dense problems, first_right only moves by a few samples : count them without branches (hist2 is sorted),
+			// and only search further when it moves more.
+			const T x = hist1[i];
+			if (first_right + 4 <= p.end1) {
+				const int steps = int(hist2[first_right] <= x) + int(hist2[first_right + 1] <= x) + int(hist2[first_right + 2] <= x) + int(hist2[first_right + 3] <= x);
+				first_right += steps;
+				if (steps == 4) {
+					first_right = galloping ? first_greater_galloping(hist2, first_right, p.end1, x) : first_greater(hist2, first_right, p.end1, x);
+				}
+			} else {
+				while (first_right < p.end1 && hist2[first_right] <= x) {
+					first_right++;
+				}
+			}
+			// From first_right - 1 on, the cost never decreases : the scan stops at the first cost above the minimum, and
+			// keeps the last of equal costs.
+			int j = std::max(p.start1, first_right - 1);
+			T mind = Cost::cost(x, hist2[j]);
+			while (j + 1 < p.end1) {
+				const T d = Cost::cost(x, hist2[j + 1]);
+				if (d > mind) {
+					break;
 				}
+				mind = d;
+				j++;
 			}
-			assignment[i] = minj;
+			assignment[i] = j;
 		}
 	}
 
@@ -175,11 +1113,11 @@ public:
 	/// @param hist2 The second histogram, the target ('Y' in the paper).
 	/// @param assignment The injective assignment map ('a' in the paper).
 	/// @param inparam The start/end bounds for both assignment problems.
-	/// @param emd The sliced Earth Mover's distance.
+	/// @param emd The sliced Earth Mover's distance. Added to without synchronization : each thread must pass its own.
 	/// @param assNN The original nearest-neighbor assignment map. Remains unchanged.
 	/// @param nbbij The number of non-injective values in the original nearest-neighbor assignment.
 	/// @returns 1 if hist1 entirely consumed ; 0 otherwise
-	template<typename T>
+	template<typename T, typename Cost = SquaredCost>
 	int reduce_range(const T *hist1, const T* hist2, std::vector<int> &assignment, params &inparam, T& emd, const int* assNN, int nbbij) {
 		params p0 = inparam;
 
@@ -190,7 +1128,7 @@ public:
 		for (int i = inparam.start0; i < inparam.end0; i++) {
 			if (hist1[i] <= hist2[cursor1]) {
 				assignment[i] = cursor1;
-				localchange += cost(hist1[i], hist2[cursor1]);
+				localchange += Cost::cost(hist1[i], hist2[cursor1]);
 				cursor1++;
 				min0 = i + 1;
 			} else break;
@@ -199,7 +1137,6 @@ public:
 		inparam.start1 = cursor1;
 
 		if (inparam.end0 == inparam.start0) {
-	#pragma omp atomic
 			emd += localchange;
 			return 1;
 		}
@@ -210,7 +1147,7 @@ public:
 		for (int i = inparam.end0 - 1; i >= inparam.start0; i--) {
 			if (hist1[i] >= hist2[cursor1b]) {
 				assignment[i] = cursor1b;
-				localchange += cost(hist1[i], hist2[cursor1b]);
+				localchange += Cost::cost(hist1[i], hist2[cursor1b]);
 				cursor1b--;
 				max0 = i - 1;
 			} else break;
@@ -220,7 +1157,6 @@ public:
 		inparam.end1 = cursor1b + 1;
 
 		if (inparam.end0 == inparam.start0) {
-	#pragma omp atomic
 			emd += localchange;
 			return 1;
 		}
@@ -241,7 +1177,7 @@ public:
 		for (i = inparam.start0; i < inparam.end0; i++) {
 			if (assNN[i] == cursor && (i == inparam.end0 - 1 || assNN[i + 1] != assNN[i])) {
 				assignment[i] = cursor;
-				localchange += cost(hist1[i], hist2[assignment[i]]);
+				localchange += Cost::cost(hist1[i], hist2[assignment[i]]);
 				cursor++;
 			} else break;
 		}
@@ -249,7 +1185,6 @@ public:
 		inparam.start1 = cursor;
 
 		if (inparam.start0 == inparam.end0) {
-	#pragma omp atomic
 			emd += localchange;
 			return 1;
 		}
@@ -261,7 +1196,7 @@ public:
 		for (i = inparam.end0 - 1; i >= inparam.start0; i--) {
 			if (assNN[i] == cursor && (i == inparam.start0 || assNN[i - 1] != assNN[i])) {
 				assignment[i] = cursor;
-				localchange += cost(hist1[i], hist2[assignment[i]]);
+				localchange += Cost::cost(hist1[i], hist2[assignment[i]]);
 				cursor--;
 			} else break;
 		}
@@ -269,13 +1204,11 @@ public:
 		inparam.end1 = cursor + 1;
 
 		if (inparam.start0 == inparam.end0) {
-	#pragma omp atomic
 			emd += localchange;
 			return 1;
 		}
 
 
-	#pragma omp atomic
 		emd += localchange;
 		return 0;
 	}
@@ -287,9 +1220,9 @@ public:
 	/// @param hist2 The coordinates of the second distribution along the random direction chosen.
 	/// @param assignment The injective mapping 'optimal' for this subproblem.
 	/// @param assNN The assignment of the nearest neighbor ???
-	/// @param value Represents the cost of this case. It's an in/out variable that's always being added to.
+	/// @param value Represents the cost of this case. It's an in/out variable that's always being added to, without synchronization.
 	/// @returns True (1) if the sub-problem was solved, and false (0) if it wasn't.
-	template<typename T>
+	template<typename T, typename Cost = SquaredCost>
 	int handle_simple_cases(const params &p, const T* hist1, const T* hist2, int* assignment, int* assNN, T &value) {
 		int start0 = p.start0;
 		int start1 = p.start1;
@@ -303,9 +1236,8 @@ public:
 			T d = 0;
 			for (int i = 0; i < M; i++) {
 				assignment[start0 + i] = i + start1;
-				d += cost(hist1[start0 + i], hist2[start1 + i]);
+				d += Cost::cost(hist1[start0 + i], hist2[start1 + i]);
 			}
-			#pragma omp atomic
 			value += d;
 			return 1;
 		}
@@ -317,15 +1249,15 @@ public:
 			T d1 = 0;
 			T d2 = 0;
 			for (int i = 0; i < M; i++) {
-				d2 += cost(hist1[start0 + i], hist2[start1 + i + 1]);
+				d2 += Cost::cost(hist1[start0 + i], hist2[start1 + i + 1]);
 			}
 			T d = 0;
 			T b = d2;
 			T best_s = d2; // this is actually optional: this is a constant.
 			int besti = -1;
 			for (int i = 0; i < M; i++) {
-				d1 += cost(hist1[start0 + i], hist2[start1 + i]); // forward cost
-				b -= cost(hist1[start0 + i], hist2[start1 + i + 1]); // backward cost
+				d1 += Cost::cost(hist1[start0 + i], hist2[start1 + i]); // forward cost
+				b -= Cost::cost(hist1[start0 + i], hist2[start1 + i + 1]); // backward cost
 				T s = b + d1;
 				if (s < best_s) {
 					best_s = s;
@@ -339,15 +1271,14 @@ public:
 					assignment[start0 + i] = i + 1 + start1;
 				}
 			}
-			#pragma omp atomic
 			value += best_s;
 			return 1;
 		}
 		if (M == 1) {
-			assignment[start0] = assNN[start0];
-			T c = cost(hist1[start0], hist2[assNN[start0]]);
+			// assNN may come from a wider range than p (see reduce_range()) : then the nearest sample in range is a bound.
+			assignment[start0] = std::min(std::max(assNN[start0], start1), end1 - 1);
+			T c = Cost::cost(hist1[start0], hist2[assignment[start0]]);
 
-			#pragma omp atomic
 			value += c;
 			return 1;
 		}
@@ -362,14 +1293,14 @@ public:
 				T h1 = hist1[start0 + i];
 				T mini = std::numeric_limits<T>::max();
 				for (int j = curId; j < N; j++) {
-					T v = cost(h1, hist2[start1 + j]);
+					T v = Cost::cost(h1, hist2[start1 + j]);
 					curId = j;
 					if (v < mini) {
 						mini = v;
 						ass = j + start1;
 					}
 					if (j < N - 1) {
-						T vnext = cost(h1, hist2[start1 + j + 1]);
+						T vnext = Cost::cost(h1, hist2[start1 + j + 1]);
 						if (vnext > v) break;
 					}
 				}
@@ -385,7 +1316,6 @@ public:
 				assignment[start0 + i] = ass;
 			}
 			if (valid) {
-				#pragma omp atomic
 				value += sumMin;
 				return 1;
 			}
@@ -404,18 +1334,28 @@ public:
 	/// @returns True if the problem was split, false if it wasn't worth it.
 	template<typename T>
 	bool linear_time_decomposition(const params &p, const T* hist1, const T* hist2, const int* assNN, std::vector<params>& newp) {
+		TransportScratch<T> scratch;
+		return linear_time_decomposition(p, hist1, hist2, assNN, newp, scratch);
+	}
+
+	/// @brief Decomposes a problem into subproblems in (quasi) linear time, using the given scratch buffers.
+	/// @param scratch The buffers to use for the decomposition. Only grown if too small for the problem.
+	/// @see linear_time_decomposition()
+	template<typename T>
+	bool linear_time_decomposition(const params &p, const T* hist1, const T* hist2, const int* assNN, std::vector<params>& newp, TransportScratch<T>& scratch) {
 
 		if (p.end0 - p.start0 < 20) { // not worth splitting already tiny problems
 			return false;
 		}
 		int N = p.end1 - p.start1;
-		std::vector<int> taken(N, -1);
-		std::vector<int> ninj(N, 0);
+		scratch.prepare(N, false);
+		std::vector<int>& taken = scratch.taken;
+		std::vector<int>& ninj = scratch.ninj;
 		taken[assNN[p.start0] - p.start1] = p.start0;
 		ninj[assNN[p.start0] - p.start1]++;
 
-		std::vector<int> prev_free(p.end1 - p.start1);
-		std::vector<int> next_free(p.end1 - p.start1);
+		std::vector<int>& prev_free = scratch.prev_free;
+		std::vector<int>& next_free = scratch.next_free;
 		for (int i = 0; i < prev_free.size(); i++) {
 			prev_free[i] = i;
 			next_free[i] = i;
@@ -500,31 +1440,127 @@ public:
 		return true;
 	}
 
-	/// @brief Solve the assignment problem for the current set of data.
-	/// @tparam T The data type of the samples to match
-	/// @param p Teh start/end fields of the assignment problem to solve.
-	/// @param hist1 The first distribution along the current direction.
-	/// @param hist2 The second distribution along the current direction.
-	/// @param assignment The injective assignment currently computed.
-	/// @param assNN The original Nearest Neighbor Assignment of the current sub-problem.
-	/// @param value The sliced Earth Mover's Distance.
+	/// @brief linear_time_decomposition() of a large problem, with chunks of the source samples decomposed in parallel.
+	/// @details Each chunk is decomposed on its own, in a window of the target samples wide enough for all the samples
+	/// it can take. When all the target samples a chunk takes are left of those the next chunk takes, the sequential
+	/// decomposition never looks across their boundary : it finds the same sub-problems, and they are stitched as they
+	/// are. Otherwise, the two chunks are merged and decomposed again, until all boundaries are independent. The result
+	/// is always the one of linear_time_decomposition().
+	/// @param workspace The buffers to use : one set of scratch buffers per thread, and the chunks' sub-problems.
+	/// @see linear_time_decomposition()
 	template<typename T>
+	bool parallel_linear_time_decomposition(const params &p, const T* hist1, const T* hist2, const int* assNN, std::vector<params>& newp, TransportWorkspace<T>& workspace) {
+		const int M = p.end0 - p.start0;
+		const int nchunks = std::max(1, std::min(omp_get_max_threads() * 4, M / 4096));
+		if (nchunks == 1) {
+			return linear_time_decomposition(p, hist1, hist2, assNN, newp, workspace.scratch[0]);
+		}
+		workspace.ensure_threads(omp_get_max_threads());
+
+		// Chunk k holds the source samples [bounds[k], bounds[k + 1]).
+		std::vector<int>& bounds = workspace.chunk_bounds;
+		std::vector<std::vector<params> >& chunk_splits = workspace.chunk_splits;
+		std::vector<char>& dirty = workspace.chunk_dirty;
+		// Chunks are more likely to be independent when cut where the nearest neighbors are the furthest apart : look for
+		// the widest gap around each evenly-spaced bound.
+		bounds.resize(nchunks + 1);
+		const int search = std::min(2048, M / nchunks / 4);
+		for (int k = 0; k <= nchunks; k++) {
+			bounds[k] = p.start0 + static_cast<int>(static_cast<long long>(M) * k / nchunks);
+			if (k == 0 || k == nchunks) continue;
+			int best = bounds[k];
+			for (int c = bounds[k] - search; c <= bounds[k] + search; c++) {
+				if (assNN[c] - assNN[c - 1] > assNN[best] - assNN[best - 1]) {
+					best = c;
+				}
+			}
+			bounds[k] = best;
+		}
+		if (static_cast<int>(chunk_splits.size()) < nchunks) {
+			chunk_splits.resize(nchunks);
+		}
+		dirty.assign(nchunks, 1);
+
+		int n = nchunks;
+		bool merged = true;
+		for (int round = 0; merged; round++) {
+			// Merged chunks can overlap their neighbors again : past a few rounds, the problem is mostly one block anyway.
+			if (round == 3) {
+				return linear_time_decomposition(p, hist1, hist2, assNN, newp, workspace.scratch[0]);
+			}
+		#pragma omp parallel for schedule(dynamic)
+			for (int k = 0; k < n; k++) {
+				if (!dirty[k]) continue;
+				// A chunk of len samples takes at most len target samples : beyond len + 1 of its nearest neighbors, the
+				// window is never reached, and its bounds are only those of p when they are clipped to them.
+				const int len = bounds[k + 1] - bounds[k];
+				params window(bounds[k], bounds[k + 1], std::max(p.start1, assNN[bounds[k]] - len - 1), std::min(p.end1, assNN[bounds[k + 1] - 1] + len + 2), 0);
+				chunk_splits[k].clear();
+				linear_time_decomposition(window, hist1, hist2, assNN, chunk_splits[k], workspace.scratch[omp_get_thread_num()]);
+				dirty[k] = 0;
+			}
+
+			// Merge each chunk into the previous one if they take overlapping target samples :
+			merged = false;
+			int groups = 1;
+			int last_end1 = chunk_splits[0].back().end1;
+			for (int k = 1; k < n; k++) {
+				const int end1 = chunk_splits[k].back().end1;
+				if (last_end1 > chunk_splits[k].front().start1) {
+					dirty[groups - 1] = 1;
+					merged = true;
+				} else {
+					std::swap(chunk_splits[groups], chunk_splits[k]);
+					bounds[groups] = bounds[k];
+					groups++;
+				}
+				last_end1 = std::max(last_end1, end1);
+			}
+			bounds[groups] = bounds[n];
+			n = groups;
+		}
+
+		for (int k = 0; k < n; k++) {
+			newp.insert(newp.end(), chunk_splits[k].begin(), chunk_splits[k].end());
+		}
+		return true;
+	}
+
+	/// @brief Solve the assignment problem for the current set of data.
+	/// @tparam T The data type of the samples to match
+	/// @param p Teh start/end fields of the assignment problem to solve.
+	/// @param hist1 The first distribution along the current direction.
+	/// @param hist2 The second distribution along the current direction.
+	/// @param assignment The injective assignment currently computed.
+	/// @param assNN The original Nearest Neighbor Assignment of the current sub-problem.
+	/// @param value The sliced Earth Mover's Distance.
+	template<typename T, typename Cost = SquaredCost>
 	void simple_solve(const params &p, const T* hist1, const T* hist2, int* assignment, int* assNN, T &value) {
+		TransportScratch<T> scratch;
+		simple_solve<T, Cost>(p, hist1, hist2, assignment, assNN, value, scratch);
+	}
+
+	/// @brief Solve the assignment problem for the current set of data, using the given scratch buffers.
+	/// @param scratch The buffers to use for the solve. Only grown if too small for the problem.
+	/// @see simple_solve()
+	template<typename T, typename Cost = SquaredCost>
+	void simple_solve(const params &p, const T* hist1, const T* hist2, int* assignment, int* assNN, T &value, TransportScratch<T>& scratch) {
 
 		int N = p.end1 - p.start1;
-		std::vector<int> taken(N, -1);
-		std::vector<int> ninj(N, 0);
+		scratch.prepare(N, true);
+		std::vector<int>& taken = scratch.taken;
+		std::vector<int>& ninj = scratch.ninj;
 		taken[assNN[p.start0] - p.start1] = p.start0;
 		ninj[assNN[p.start0] - p.start1]++;
 
-		std::vector<int> prev_free(p.end1 - p.start1);
-		std::vector<int> next_free(p.end1 - p.start1);
-		std::vector<T> cost_dontMove(p.end1 - p.start1, 0);
-		std::vector<T> cost_moveLeft(p.end1 - p.start1, 0);
+		std::vector<int>& prev_free = scratch.prev_free;
+		std::vector<int>& next_free = scratch.next_free;
+		std::vector<T>& cost_dontMove = scratch.cost_dontMove;
+		std::vector<T>& cost_moveLeft = scratch.cost_moveLeft;
 		int ass0 = assNN[p.start0];
 		bool lastok = true;
-		cost_dontMove[assNN[p.start0] - p.start1] = cost(hist1[p.start0], hist2[ass0]);
-		cost_moveLeft[assNN[p.start0] - p.start1] = (ass0==0)?std::numeric_limits<T>::max():cost(hist1[p.start0], hist2[ass0 -1]);
+		cost_dontMove[assNN[p.start0] - p.start1] = Cost::cost(hist1[p.start0], hist2[ass0]);
+		cost_moveLeft[assNN[p.start0] - p.start1] = (ass0==0)?std::numeric_limits<T>::max():Cost::cost(hist1[p.start0], hist2[ass0 -1]);
 
 		for (int i = 0; i < prev_free.size(); i++) {
 			prev_free[i] = i;
@@ -540,8 +1576,8 @@ public:
 				taken[assOffset] = i;
 				first_right = assOffset;
 				last_left = assOffset;
-				cost_dontMove[assOffset] = cost(hist1[i], hist2[ass]);
-				cost_moveLeft[assOffset] = (ass == 0) ? std::numeric_limits<T>::max() : cost(hist1[i], hist2[ass-1]);
+				cost_dontMove[assOffset] = Cost::cost(hist1[i], hist2[ass]);
+				cost_moveLeft[assOffset] = (ass == 0) ? std::numeric_limits<T>::max() : Cost::cost(hist1[i], hist2[ass-1]);
 				lastok = true;
 			} else {
 
@@ -569,16 +1605,16 @@ public:
 					if (first_right >= N - 1)
 						cdM = std::numeric_limits<T>::max();
 					else
-						cdM = sumDontMove + cost(hist1[i], hist2[p.start1 + first_right + 1]);
+						cdM = sumDontMove + Cost::cost(hist1[i], hist2[p.start1 + first_right + 1]);
 					if (cur < 0) {
 						cmL = std::numeric_limits<T>::max();
 					} else {
 						if (isok)
-							cmL = sumMoveLeft + cost(hist1[i], hist2[p.start1 + first_right]);
+							cmL = sumMoveLeft + Cost::cost(hist1[i], hist2[p.start1 + first_right]);
 						else {
 							cmL = 0;
 							if (cur >= 0 && first_right < N - 1) {
-								cmL = sumCosts(hist1, i - (first_right - cur), hist2, p.start1 + cur + 1 - 1, first_right-cur+1);
+								cmL = Cost::sum_costs(hist1, i - (first_right - cur), hist2, p.start1 + cur + 1 - 1, first_right-cur+1);
 							}
 						}
 
@@ -624,7 +1660,7 @@ public:
 					curp.end1 = curp.start1 + 1;
 					for (int j = 0; j < curp.end0 - curp.start0; j++) {
 						assignment[curp.start0 + j] = curp.start1 + j;
-						value += cost(hist1[curp.start0 + j], hist2[curp.start1 + j]);
+						value += Cost::cost(hist1[curp.start0 + j], hist2[curp.start1 + j]);
 					}
 				}
 				else {
@@ -642,7 +1678,7 @@ public:
 					curp.end1 = p.start1 + right + 1;
 					for (int j = 0; j < curp.end0 - curp.start0; j++) {
 						assignment[curp.start0 + j] = curp.start1 + j;
-						value += cost(hist1[curp.start0 + j], hist2[curp.start1 + j]);
+						value += Cost::cost(hist1[curp.start0 + j], hist2[curp.start1 + j]);
 					}
 					i = p.start1 + right;
 				}
@@ -658,38 +1694,578 @@ public:
 	/// @param N0 The size of the target distribution, in number of samples.
 	/// @param assignment The computed assignment for this particular slice of the optimal transport plan.
 	/// @param timingSplits Unused. Leftover from earlier (benchmarked?) code maybe ?
+	/// @tparam Cost The ground cost policy (see cost_policies.h). Defaults to the squared Euclidean cost.
 	/// @returns The sliced EMD distance along that axis.
-	template<typename T>
+	/// @note Allocates a new workspace on each call. Prefer the overload taking a TransportWorkspace when solving many slices.
+	/// @note Balanced slices (M0 == N0) skip the partial transport machinery : see balanced_transport1d().
+	template<typename T, typename Cost = SquaredCost>
 	T transport1d(const T *hist1, const T* hist2, int M0, int N0, std::vector<int> &assignment, double* timingSplits = nullptr) {
+		TransportWorkspace<T> workspace;
+		return transport1d<T, Cost>(hist1, hist2, M0, N0, assignment, workspace, timingSplits);
+	}
+
+	/// @brief Performs the 1D Sliced Partial Optimal Transport, drawing all temporary buffers from the given workspace.
+	/// @param workspace The caller-owned buffers to use. Once sized for the largest M0/N0 seen, no heap allocations are performed.
+	/// @see transport1d()
+	template<typename T, typename Cost = SquaredCost>
+	T transport1d(const T *hist1, const T* hist2, int M0, int N0, std::vector<int> &assignment, TransportWorkspace<T>& workspace, double* timingSplits = nullptr) {
+		T sliced_earth_mover_distance = 0;
+		workspace.ensure_threads(omp_get_max_threads());
+		if (decompose_slice<T, Cost>(hist1, hist2, M0, N0, assignment, workspace, sliced_earth_mover_distance)) {
+			return sliced_earth_mover_distance;
+		}
+
+		// For all sub-problems which couldn't be matched above, solve them. Each one has its own cost slot, so that the
+		// final sum does not depend on the number of threads or on the scheduling :
+		std::vector<params>& todo = workspace.todo;
+		std::vector<T>& partial_costs = workspace.partial_costs;
+		partial_costs.assign(todo.size(), 0);
+		SPOT_TRANSPORT_STATS(micro_benchmarks::timepoint_t phase_start = micro_benchmarks::my_clock_t::now();)
+	#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < todo.size(); i++) {
+			solve_subproblem<T, Cost>(todo[i], hist1, hist2, assignment, workspace.nearest_neighbor_assignment, partial_costs[i], workspace.scratch[omp_get_thread_num()]);
+		}
+		for (int i = 0; i < todo.size(); i++) {
+			sliced_earth_mover_distance += partial_costs[i];
+		}
+		SPOT_TRANSPORT_STATS(
+			workspace.stats.subproblems_time += micro_benchmarks::TransportStats::lap(phase_start);
+			for (TransportScratch<T>& scratch : workspace.scratch) {
+				workspace.stats.merge(scratch.stats);
+				scratch.stats.reset();
+			}
+		)
+
+		return sliced_earth_mover_distance;
+	}
+
+	/// @brief Performs the 1D Sliced Partial Optimal Transport on K independent slices at once.
+	/// @details The sequential front end of each slice (see decompose_slice()) runs in parallel across slices, then all
+	/// the (slice, sub-problem) pairs left are solved by a single parallel loop. This keeps all threads busy even when
+	/// each slice only decomposes into a handful of sub-problems.
+	/// @param hist1 The K source distributions, each sorted and projected along one direction.
+	/// @param hist2 The K target distributions, each sorted and projected along the same direction as in hist1.
+	/// @param M0 The sizes of the K source distributions.
+	/// @param N0 The sizes of the K target distributions.
+	/// @param assignments The K computed assignments. Resized if needed.
+	/// @param emds The K sliced EMD distances. Resized if needed.
+	/// @param workspace The caller-owned buffers to use, kept across batches to avoid re-allocating them.
+	template<typename T, typename Cost = SquaredCost>
+	void transport1d_batch(const std::vector<const T*> &hist1, const std::vector<const T*> &hist2, const std::vector<int> &M0, const std::vector<int> &N0,
+						   std::vector<std::vector<int>> &assignments, std::vector<T> &emds, TransportBatchWorkspace<T>& workspace) {
+		const int K = static_cast<int>(hist1.size());
+		workspace.ensure(K, omp_get_max_threads());
+		assignments.resize(K);
+		emds.assign(K, 0);
+
+		std::vector<char>& solved = workspace.solved;
+		solved.assign(K, 0);
+	#pragma omp parallel for schedule(dynamic)
+		for (int k = 0; k < K; k++) {
+			solved[k] = decompose_slice<T, Cost>(hist1[k], hist2[k], M0[k], N0[k], assignments[k], workspace.slices[k], emds[k]);
+		}
+
+		std::vector<std::pair<int, int>>& tasks = workspace.tasks;
+		tasks.clear();
+		for (int k = 0; k < K; k++) {
+			if (solved[k]) continue;
+			for (int i = 0; i < workspace.slices[k].todo.size(); i++) {
+				tasks.emplace_back(k, i);
+			}
+		}
+
+		std::vector<T>& partial_costs = workspace.partial_costs;
+		partial_costs.assign(tasks.size(), 0);
+		SPOT_TRANSPORT_STATS(micro_benchmarks::timepoint_t phase_start = micro_benchmarks::my_clock_t::now();)
+	#pragma omp parallel for schedule(dynamic)
+		for (int t = 0; t < tasks.size(); t++) {
+			const int k = tasks[t].first;
+			TransportWorkspace<T>& slice = workspace.slices[k];
+			solve_subproblem<T, Cost>(slice.todo[tasks[t].second], hist1[k], hist2[k], assignments[k], slice.nearest_neighbor_assignment, partial_costs[t], workspace.scratch[omp_get_thread_num()]);
+		}
+		// Tasks are sorted by slice, then by sub-problem : this sums each slice in the same order as transport1d().
+		for (int t = 0; t < tasks.size(); t++) {
+			emds[tasks[t].first] += partial_costs[t];
+		}
+		SPOT_TRANSPORT_STATS(
+			workspace.stats.subproblems_time += micro_benchmarks::TransportStats::lap(phase_start);
+			for (int k = 0; k < K; k++) {
+				workspace.stats.merge(workspace.slices[k].stats);
+				workspace.slices[k].stats.reset();
+			}
+			for (TransportScratch<T>& scratch : workspace.scratch) {
+				workspace.stats.merge(scratch.stats);
+				scratch.stats.reset();
+			}
+		)
+	}
+
+	/// @brief Performs the 1D Sliced Partial Optimal Transport on K independent slices at once, with a temporary workspace.
+	/// @see transport1d_batch()
+	template<typename T, typename Cost = SquaredCost>
+	void transport1d_batch(const std::vector<const T*> &hist1, const std::vector<const T*> &hist2, const std::vector<int> &M0, const std::vector<int> &N0,
+						   std::vector<std::vector<int>> &assignments, std::vector<T> &emds) {
+		TransportBatchWorkspace<T> workspace;
+		transport1d_batch<T, Cost>(hist1, hist2, M0, N0, assignments, emds, workspace);
+	}
+
+	/// @brief Solves a balanced slice (as many source as target samples) : the i-th source sample goes to the i-th target sample.
+	/// @details This is the M == N case of handle_simple_cases(), without the nearest neighbor match, reduce_range() and
+	/// decomposition transport1d() would run first. The cost is summed by the SIMD kernel of the cost policy.
+	/// @param hist1 The source distribution, sorted and aligned as by malloc_simd().
+	/// @param hist2 The target distribution, sorted, of the same size.
+	/// @param M0 The size of both distributions, in number of samples.
+	/// @param assignment The identity assignment. Resized to M0.
+	/// @returns The sliced EMD distance along that axis.
+	template<typename T, typename Cost = SquaredCost>
+	T balanced_transport1d(const T *hist1, const T* hist2, int M0, std::vector<int> &assignment) {
 		assignment.resize(M0);
-		params initial_parameters(0, M0, 0, N0, 0);
+		for (int i = 0; i < M0; i++) {
+			assignment[i] = i;
+		}
+		return M0 > 0 ? Cost::sum_costs(hist1, 0, hist2, 0, M0) : T(0);
+	}
+
+	/// @brief 1D Sliced Partial Optimal Transport of weighted diracs : all the mass of hist1 is moved to hist2, whose
+	/// masses are capacities.
+	/// @details Works on the weighted samples directly, in cumulative mass : the plan is monotone, so it is made of runs
+	/// of source samples, each matched in order to a contiguous range of target mass. Balanced slices are one such run.
+	/// Otherwise, the sources are added in order as in simple_solve() : the mass of each one either extends the last
+	/// run to the right, or shifts it to the left, whichever costs less, until the masses or the targets met change.
+	/// The plan lists (source, target, mass) in increasing source, then target, order.
+	/// @param hist1 The source distribution, sorted.
+	/// @param mass1 The mass of each source sample.
+	/// @param M0 The size of the source distribution, in number of samples.
+	/// @param hist2 The target distribution, sorted.
+	/// @param mass2 The mass of each target sample. Its total must not be less than the one of mass1.
+	/// @param N0 The size of the target distribution, in number of samples.
+	/// @param plan The computed transport plan.
+	/// @param workspace The caller-owned buffers to use.
+	/// @returns The sliced EMD distance along that axis : the sum of the costs weighted by the masses moved.
+	template<typename T, typename Cost = SquaredCost>
+	T weighted_transport1d(const T *hist1, const T *mass1, int M0, const T *hist2, const T *mass2, int N0, std::vector<TransportPlanEntry<T>> &plan,
+						   WeightedTransportWorkspace<T> &workspace) {
+		workspace.sources.clear();
+		workspace.source_positions.clear();
+		workspace.source_bounds.assign(1, 0.);
+		for (int i = 0; i < M0; i++) {
+			if (mass1[i] > 0) {
+				workspace.sources.push_back(i);
+				workspace.source_positions.push_back(hist1[i]);
+				workspace.source_bounds.push_back(workspace.source_bounds.back() + mass1[i]);
+			}
+		}
+		workspace.targets.clear();
+		workspace.target_positions.clear();
+		workspace.target_bounds.assign(1, 0.);
+		for (int j = 0; j < N0; j++) {
+			if (mass2[j] > 0) {
+				workspace.targets.push_back(j);
+				workspace.target_positions.push_back(hist2[j]);
+				workspace.target_bounds.push_back(workspace.target_bounds.back() + mass2[j]);
+			}
+		}
+		const double total1 = workspace.source_bounds.back();
+		const double total2 = workspace.target_bounds.back();
+		// Totals closer than the rounding of the masses are equal. Event positions are compared up to the rounding of the sums.
+		const double mass_tolerance = std::numeric_limits<T>::epsilon() * std::max(total1, total2);
+		const double tolerance = 64 * std::numeric_limits<double>::epsilon() * std::max(total1, total2);
+		if (total1 > total2 + mass_tolerance) {
+			throw std::invalid_argument("weighted_transport1d : the source mass exceeds the target mass.");
+		}
+
+		plan.clear();
+		workspace.runs.clear();
+		if (workspace.sources.empty()) {
+			return 0;
+		}
+		workspace.target_bounds.back() = std::max(total1, total2);
+		if (total1 + mass_tolerance >= total2) {
+			workspace.runs.push_back(WeightedRun{0, 0., 0.});
+		} else {
+			weighted_runs<T, Cost>(workspace, tolerance);
+		}
+		return weighted_plan<T, Cost>(workspace, plan, tolerance);
+	}
+
+	/// @brief 1D Sliced Partial Optimal Transport of weighted diracs, with a temporary workspace.
+	/// @see weighted_transport1d()
+	template<typename T, typename Cost = SquaredCost>
+	T weighted_transport1d(const T *hist1, const T *mass1, int M0, const T *hist2, const T *mass2, int N0, std::vector<TransportPlanEntry<T>> &plan) {
+		WeightedTransportWorkspace<T> workspace;
+		return weighted_transport1d<T, Cost>(hist1, mass1, M0, hist2, mass2, N0, plan, workspace);
+	}
+
+	/// @brief Builds the runs of the partial plan of weighted_transport1d(), from the samples of its workspace.
+	/// @details Each source starts at its nearest target, or at the end of the last run if that is further. Its mass is
+	/// then added by steps. Extending the run to the right costs the source's cost to the next free target. Shifting
+	/// the run to the left costs its cost to the last target of the run, plus, at each target boundary inside the run,
+	/// the change of cost of the source mass moved across it. A step stops where one of these rates changes : at a
+	/// target boundary, when a boundary inside the run reaches the next source, or when the run meets the previous
+	/// one, which then shift together. The rate of each run is kept up to date at these events, from a heap of the
+	/// offsets at which its boundaries reach their next source.
+	/// @param tolerance The distance, in mass, under which two positions are the same.
+	template<typename T, typename Cost>
+	static void weighted_runs(WeightedTransportWorkspace<T> &workspace, double tolerance) {
+		const std::vector<T>& x = workspace.source_positions;
+		const std::vector<T>& y = workspace.target_positions;
+		const std::vector<double>& A = workspace.source_bounds;
+		const std::vector<double>& B = workspace.target_bounds;
+		std::vector<WeightedRun>& runs = workspace.runs;
+		std::vector<int>& crossed = workspace.crossed;
+		std::vector<std::pair<double, int>>& crossings = workspace.crossings;
+		const int M = static_cast<int>(x.size());
+		const int N = static_cast<int>(y.size());
+		crossed.assign(N, 0);
+		crossings.clear();
+
+		// The change of cost when mass of source s moves across target boundary j, from targets j to j - 1 :
+		const auto boundary_rate = [&](int j, int s) {
+			return static_cast<double>(Cost::cost(x[s], y[j - 1])) - static_cast<double>(Cost::cost(x[s], y[j]));
+		};
+		// Target boundary j enters the run at the source position sigma :
+		const auto enter = [&](WeightedRun& run, int j, double sigma) {
+			const int s = std::min(M - 1, static_cast<int>(std::upper_bound(A.begin(), A.end(), sigma + tolerance) - A.begin()) - 1);
+			crossed[j] = s;
+			run.rate += boundary_rate(j, s);
+			crossings.emplace_back(B[j] - A[s + 1], j);
+			std::push_heap(crossings.begin(), crossings.end());
+		};
+
+		int nearest = 0;
+		for (int q = 0; q < M; q++) {
+			// Both distributions are sorted : the nearest target only moves forward.
+			while (nearest + 1 < N && y[nearest + 1] <= x[q]) {
+				nearest++;
+			}
+			const int best = (nearest + 1 < N && y[nearest + 1] - x[q] < x[q] - y[nearest]) ? nearest + 1 : nearest;
+			const double previous_end = runs.empty() ? 0. : runs.back().start + (A[q] - A[runs.back().first]);
+			if (runs.empty() || B[best] > previous_end + tolerance) {
+				runs.push_back(WeightedRun{q, B[best], 0.});
+			}
+
+			double placed = A[q];
+			while (A[q + 1] - placed > tolerance) {
+				WeightedRun& run = runs.back();
+				const double l = run.start;
+				const double r = l + (placed - A[run.first]);
+				const double floor = runs.size() > 1 ? runs[runs.size() - 2].start + (A[run.first] - A[runs[runs.size() - 2].first]) : 0.;
+				if (runs.size() > 1 && l - floor <= tolerance) {
+					runs[runs.size() - 2].rate += run.rate;
+					runs.pop_back();
+					continue;
+				}
+
+				const bool can_extend = r + tolerance < B[N];
+				const bool can_shift = l - floor > tolerance;
+				double extend_rate = std::numeric_limits<double>::max();
+				double extend_step = 0;
+				const int j = static_cast<int>(std::upper_bound(B.begin(), B.end(), r + tolerance) - B.begin()) - 1;
+				if (can_extend) {
+					extend_rate = Cost::cost(x[q], y[j]);
+					extend_step = B[j + 1] - r;
+				}
+				double shift_rate = std::numeric_limits<double>::max();
+				double shift_step = 0, shift_to = floor;
+				const int k = static_cast<int>(std::lower_bound(B.begin(), B.end(), l - tolerance) - B.begin()) - 1;
+				if (can_shift) {
+					const int last_target = static_cast<int>(std::lower_bound(B.begin(), B.end(), r - tolerance) - B.begin()) - 1;
+					shift_rate = run.rate + Cost::cost(x[q], y[last_target]);
+					shift_to = std::max(floor, B[k]);
+					shift_step = l - shift_to;
+					if (!crossings.empty()) {
+						shift_step = std::min(shift_step, (l - A[run.first]) - crossings.front().first);
+					}
+				}
+				if (!can_extend && !can_shift) {
+					break;
+				}
+
+				const double remaining = A[q + 1] - placed;
+				if (can_shift && (!can_extend || shift_rate < extend_rate)) {
+					const double step = std::min(remaining, shift_step);
+					run.start = step < l - shift_to ? l - step : shift_to;
+					placed += step;
+					const double offset = run.start - A[run.first];
+					while (!crossings.empty() && crossings.front().first >= offset - tolerance) {
+						std::pop_heap(crossings.begin(), crossings.end());
+						const int boundary = crossings.back().second;
+						crossings.pop_back();
+						run.rate -= boundary_rate(boundary, crossed[boundary]);
+						enter(run, boundary, B[boundary] - offset);
+					}
+					if (run.start == B[k] && k > 0) {
+						enter(run, k, A[run.first]);
+					}
+				} else {
+					if (j > 0 && B[j] >= r - tolerance) {
+						enter(run, j, placed);
+					}
+					placed += std::min(remaining, extend_step);
+				}
+			}
+		}
+	}
+
+	/// @brief Writes the plan of the runs of weighted_transport1d(), and returns its cost.
+	/// @param tolerance The mass under which a piece of the plan is dropped.
+	template<typename T, typename Cost>
+	static T weighted_plan(const WeightedTransportWorkspace<T> &workspace, std::vector<TransportPlanEntry<T>> &plan, double tolerance) {
+		const std::vector<T>& x = workspace.source_positions;
+		const std::vector<T>& y = workspace.target_positions;
+		const std::vector<double>& A = workspace.source_bounds;
+		const std::vector<double>& B = workspace.target_bounds;
+		const std::vector<WeightedRun>& runs = workspace.runs;
+		const int M = static_cast<int>(x.size());
+		const int N = static_cast<int>(y.size());
+
+		double emd = 0;
+		int j = 0;
+		for (std::size_t k = 0; k < runs.size(); k++) {
+			const int end = k + 1 < runs.size() ? runs[k + 1].first : M;
+			const double offset = runs[k].start - A[runs[k].first];
+			for (int q = runs[k].first; q < end; q++) {
+				for (double u = A[q]; A[q + 1] - u > tolerance;) {
+					while (j + 1 < N && B[j + 1] <= u + offset + tolerance) {
+						j++;
+					}
+					const double next = j + 1 < N ? std::min(A[q + 1], B[j + 1] - offset) : A[q + 1];
+					const T mass = static_cast<T>(next - u);
+					if (!plan.empty() && plan.back().source == workspace.sources[q] && plan.back().target == workspace.targets[j]) {
+						plan.back().mass += mass;
+					} else {
+						plan.push_back(TransportPlanEntry<T>{workspace.sources[q], workspace.targets[j], mass});
+					}
+					emd += (next - u) * Cost::cost(x[q], y[j]);
+					u = next;
+				}
+			}
+		}
+		return static_cast<T>(emd);
+	}
+
+	/// @brief Where a transport plan sends each source sample, on average : the mass-weighted mean of its targets.
+	/// @param plan A plan of weighted_transport1d().
+	/// @param hist1 The source distribution of the plan.
+	/// @param hist2 The target distribution of the plan.
+	/// @param M0 The size of the source distribution, in number of samples.
+	/// @param targets The barycentric projection of each source sample. Samples without mass stay in place. Resized to M0.
+	template<typename T>
+	static void barycentric_projection(const std::vector<TransportPlanEntry<T>> &plan, const T *hist1, const T *hist2, int M0, std::vector<T> &targets) {
+		targets.assign(hist1, hist1 + M0);
+		for (std::size_t k = 0; k < plan.size();) {
+			const int i = plan[k].source;
+			T mass = 0, moment = 0;
+			for (; k < plan.size() && plan[k].source == i; k++) {
+				mass += plan[k].mass;
+				moment += plan[k].mass * hist2[plan[k].target];
+			}
+			targets[i] = moment / mass;
+		}
+	}
+
+	/// @brief Approximate 1D Sliced Partial Optimal Transport, for interactive previews.
+	/// @details Runs the exact front end of transport1d() (see decompose_slice()), and solves its sub-problems as
+	/// solve_subproblem() does, except for the ones left to simple_solve() : those are approximated by
+	/// quantile_interpolation_solve() instead. This makes the whole slice O(M0 + N0) on sorted inputs.
+	/// @param hist1 The source distribution, sorted and aligned as by malloc_simd().
+	/// @param hist2 The target distribution, sorted.
+	/// @param M0 The size of the source distribution, in number of samples.
+	/// @param N0 The size of the target distribution, in number of samples.
+	/// @param assignment The computed injective assignment. Resized to M0.
+	/// @param settings The accuracy/speed trade-off.
+	/// @param extra_cost_bound Set to an upper bound of the returned cost minus the cost of transport1d().
+	/// @param workspace The caller-owned buffers to use.
+	/// @returns The cost of the assignment.
+	template<typename T, typename Cost = SquaredCost>
+	T approximate_transport1d(const T *hist1, const T* hist2, int M0, int N0, std::vector<int> &assignment, const QuantileApproximation &settings,
+							  T &extra_cost_bound, TransportWorkspace<T>& workspace) {
 		T sliced_earth_mover_distance = 0;
+		extra_cost_bound = 0;
+		workspace.ensure_threads(omp_get_max_threads());
+		if (decompose_slice<T, Cost>(hist1, hist2, M0, N0, assignment, workspace, sliced_earth_mover_distance)) {
+			return sliced_earth_mover_distance;
+		}
+
+		std::vector<params>& todo = workspace.todo;
+		std::vector<T>& partial_costs = workspace.partial_costs;
+		std::vector<T>& partial_bounds = workspace.partial_bounds;
+		partial_costs.assign(todo.size(), 0);
+		partial_bounds.assign(todo.size(), 0);
+	#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < todo.size(); i++) {
+			solve_subproblem<T, Cost>(todo[i], hist1, hist2, assignment, workspace.nearest_neighbor_assignment, partial_costs[i], workspace.scratch[omp_get_thread_num()],
+									  &settings, &partial_bounds[i]);
+		}
+		for (int i = 0; i < todo.size(); i++) {
+			sliced_earth_mover_distance += partial_costs[i];
+			extra_cost_bound += partial_bounds[i];
+		}
+		return sliced_earth_mover_distance;
+	}
+
+	/// @brief Approximate 1D Sliced Partial Optimal Transport, with a temporary workspace.
+	/// @see approximate_transport1d()
+	template<typename T, typename Cost = SquaredCost>
+	T approximate_transport1d(const T *hist1, const T* hist2, int M0, int N0, std::vector<int> &assignment, const QuantileApproximation &settings,
+							  T &extra_cost_bound) {
+		TransportWorkspace<T> workspace;
+		return approximate_transport1d<T, Cost>(hist1, hist2, M0, N0, assignment, settings, extra_cost_bound, workspace);
+	}
+
+	/// @brief Approximates a sub-problem by interpolating its source quantiles over its target quantiles, on a coarse grid.
+	/// @details Source sample start0 + i is matched to target sample start1 + i + u(i), u non-decreasing in [0, N - M] so
+	/// that the assignment is injective. On a grid of 4 * settings.grid source quantiles, u is the least-squares fit of the
+	/// nearest-neighbor offsets (by pool-adjacent-violators) : the exact solution when the target samples are evenly spaced.
+	/// Between grid points, u is interpolated linearly. Then, the first and last settings.refine source samples are solved
+	/// exactly : the fit is the least accurate at the ends of the window of target samples it matches.
+	/// @param p The bounds of the sub-problem. Its nearest-neighbor assignment must be up to date.
+	/// @param value The sliced EMD distance, added to with the cost of the sub-problem.
+	/// @param bound Added to with an upper bound of the extra cost versus the exact solution : the cost minus the one of
+	/// the nearest-neighbor assignment, which no injective assignment can beat.
+	template<typename T, typename Cost = SquaredCost>
+	void quantile_interpolation_solve(const params &p, const T* hist1, const T* hist2, std::vector<int> &assignment, std::vector<int> &nearest_neighbor_assignment,
+									  T &value, TransportScratch<T>& scratch, const QuantileApproximation &settings, T &bound) {
+		const int M = p.end0 - p.start0;
+		const int N = p.end1 - p.start1;
+		const int refine = std::max(0, settings.refine);
+		const int Q = std::min(M, 4 * std::max(1, settings.grid)); // >= 4, see solve_subproblem()
+
+		T lower_bound = 0;
+		for (int i = p.start0; i < p.end0; i++) {
+			lower_bound += Cost::cost(hist1[i], hist2[nearest_neighbor_assignment[i]]);
+		}
+
+		// Grid of source quantiles, and the offset of their nearest neighbor. Pool adjacent violators : merge the blocks
+		// of decreasing offsets into their mean, so that the offsets are non-decreasing.
+		std::vector<int>& grid = scratch.taken;
+		std::vector<int>& block_end = scratch.ninj;
+		std::vector<T>& offset = scratch.cost_dontMove;
+		std::vector<T>& weight = scratch.cost_moveLeft;
+		grid.resize(Q);
+		block_end.resize(Q);
+		offset.resize(Q);
+		weight.resize(Q);
+		int blocks = 0;
+		for (int q = 0; q < Q; q++) {
+			grid[q] = Q > 1 ? static_cast<int>(static_cast<long long>(M - 1) * q / (Q - 1)) : 0;
+			offset[blocks] = static_cast<T>(nearest_neighbor_assignment[p.start0 + grid[q]] - p.start1 - grid[q]);
+			weight[blocks] = 1;
+			block_end[blocks] = q + 1;
+			blocks++;
+			while (blocks > 1 && offset[blocks - 2] > offset[blocks - 1]) {
+				const T w = weight[blocks - 2] + weight[blocks - 1];
+				offset[blocks - 2] = (offset[blocks - 2] * weight[blocks - 2] + offset[blocks - 1] * weight[blocks - 1]) / w;
+				weight[blocks - 2] = w;
+				block_end[blocks - 2] = block_end[blocks - 1];
+				blocks--;
+			}
+		}
+		// Expand the blocks back to one clamped offset per grid point, into weight (block b only covers grid points >= b) :
+		for (int b = blocks - 1; b >= 0; b--) {
+			const T u = std::min(std::max(offset[b], T(0)), T(N - M));
+			for (int q = b > 0 ? block_end[b - 1] : 0; q < block_end[b]; q++) {
+				weight[q] = u;
+			}
+		}
+
+		for (int q = 0; q + 1 < Q; q++) {
+			const int first = grid[q];
+			const int last = grid[q + 1];
+			for (int i = first; i <= last; i++) {
+				const T u = weight[q] + (weight[q + 1] - weight[q]) * T(i - first) / T(std::max(1, last - first));
+				assignment[p.start0 + i] = p.start1 + i + static_cast<int>(u + T(0.5));
+			}
+		}
+		T cost = 0;
+		for (int i = p.start0 + refine; i < p.end0 - refine; i++) {
+			cost += Cost::cost(hist1[i], hist2[assignment[i]]);
+		}
+
+		if (refine > 0) {
+			// The first samples, to the targets left of the rest of the window, and the last ones, to the targets right of it :
+			const params head(p.start0, p.start0 + refine, std::max(p.start1, assignment[p.start0] - refine), assignment[p.start0 + refine], 0);
+			const params tail(p.end0 - refine, p.end0, assignment[p.end0 - refine - 1] + 1, std::min(p.end1, assignment[p.end0 - 1] + refine + 1), 0);
+			// Both ends are part of this sub-problem : they must not be counted as sub-problems of their own.
+			SPOT_TRANSPORT_STATS(const micro_benchmarks::TransportStats stats = scratch.stats;)
+			solve_subproblem<T, Cost>(head, hist1, hist2, assignment, nearest_neighbor_assignment, cost, scratch);
+			solve_subproblem<T, Cost>(tail, hist1, hist2, assignment, nearest_neighbor_assignment, cost, scratch);
+			SPOT_TRANSPORT_STATS(scratch.stats = stats;)
+		}
+
+		value += cost;
+		bound += std::max(T(0), cost - lower_bound);
+	}
+
+	/// @brief Sequential front end of transport1d() : matches what can be matched directly, and splits the rest into sub-problems.
+	/// @details Performs the initial nearest-neighbor match, reduce_range() and linear_time_decomposition(). The sub-problems
+	/// left to solve with solve_subproblem() are stored in workspace.todo. Balanced slices are solved directly, by
+	/// balanced_transport1d().
+	/// @param hist1 The source distribution, projected along a random direction.
+	/// @param hist2 The target distribution, projected along the same random direction.
+	/// @param M0 The size of the source distribution, in number of samples.
+	/// @param N0 The size of the target distribution, in number of samples.
+	/// @param assignment The computed assignment for this slice. Resized to M0.
+	/// @param workspace The buffers to use. Holds the nearest-neighbor assignment and the sub-problems on return.
+	/// @param emd The sliced EMD distance, added to with the cost of everything matched here.
+	/// @returns True if the slice was entirely solved, false if sub-problems are left in workspace.todo.
+	template<typename T, typename Cost = SquaredCost>
+	bool decompose_slice(const T *hist1, const T* hist2, int M0, int N0, std::vector<int> &assignment, TransportWorkspace<T>& workspace, T& emd) {
+		if (M0 == N0) {
+			emd += balanced_transport1d<T, Cost>(hist1, hist2, M0, assignment);
+			SPOT_TRANSPORT_STATS(workspace.stats.slices++; workspace.stats.slices_balanced++;)
+			return true;
+		}
+		assignment.resize(M0);
+		params initial_parameters(0, M0, 0, N0, 0);
+		if (workspace.scratch.empty()) {
+			workspace.ensure_threads(1);
+		}
+
+		SPOT_TRANSPORT_STATS(
+			micro_benchmarks::TransportStats& stats = workspace.stats;
+			micro_benchmarks::timepoint_t phase_start = micro_benchmarks::my_clock_t::now();
+			stats.slices++;
+		)
 
 		// starts computing nearest neighbor match
-		std::vector<int> nearest_neighbor_assignment(M0);
-		nearest_neighbor_match(hist1, hist2, initial_parameters, nearest_neighbor_assignment);
+		std::vector<int>& nearest_neighbor_assignment = workspace.nearest_neighbor_assignment;
+		nearest_neighbor_assignment.resize(M0);
+		nearest_neighbor_match<T, Cost>(hist1, hist2, initial_parameters, nearest_neighbor_assignment);
+		SPOT_TRANSPORT_STATS(stats.nearest_neighbor_time += micro_benchmarks::TransportStats::lap(phase_start);)
 
 		// Check the number of non-injective matches in all intervals :
+		const bool parallel = M0 >= parallel_front_end_size && !omp_in_parallel() && omp_get_max_threads() > 1;
 		int non_injective_matches = 0;
+	#pragma omp parallel for reduction(+:non_injective_matches) if(parallel)
 		for (int i = initial_parameters.start0 + 1; i < initial_parameters.end0; i++) {
 			if (nearest_neighbor_assignment[i] == nearest_neighbor_assignment[i - 1]) non_injective_matches++;
 		}
 
-		int ret1 = reduce_range(hist1, hist2, assignment, initial_parameters, sliced_earth_mover_distance, &nearest_neighbor_assignment[0], non_injective_matches);
-		if (ret1 == 1) return sliced_earth_mover_distance;
+		int ret1 = reduce_range<T, Cost>(hist1, hist2, assignment, initial_parameters, emd, &nearest_neighbor_assignment[0], non_injective_matches);
+		SPOT_TRANSPORT_STATS(stats.reduce_range_time += micro_benchmarks::TransportStats::lap(phase_start);)
+		if (ret1 == 1) {
+			SPOT_TRANSPORT_STATS(stats.slices_solved_by_reduce_range++;)
+			return true;
+		}
 
-		nearest_neighbor_match(hist1, hist2, initial_parameters, nearest_neighbor_assignment); // since the bounds of the problem have changed, the NN maps has changed as well
-		std::vector<params> splits;
+		nearest_neighbor_match<T, Cost>(hist1, hist2, initial_parameters, nearest_neighbor_assignment); // since the bounds of the problem have changed, the NN maps has changed as well
+		SPOT_TRANSPORT_STATS(stats.nearest_neighbor_time += micro_benchmarks::TransportStats::lap(phase_start);)
+		std::vector<params>& splits = workspace.splits;
+		splits.clear();
 
-		bool res = linear_time_decomposition(initial_parameters, hist1, hist2, &nearest_neighbor_assignment[0], splits);
+		bool res = parallel ? parallel_linear_time_decomposition(initial_parameters, hist1, hist2, &nearest_neighbor_assignment[0], splits, workspace)
+							: linear_time_decomposition(initial_parameters, hist1, hist2, &nearest_neighbor_assignment[0], splits, workspace.scratch[0]);
+		SPOT_TRANSPORT_STATS(stats.decomposition_time += micro_benchmarks::TransportStats::lap(phase_start);)
 
-		std::vector<params> todo;
+		std::vector<params>& todo = workspace.todo;
+		todo.clear();
 		if (res) {
-			todo.reserve(splits.size());
 			for (int i = 0; i < splits.size(); i++) {
 				if (splits[i].end0 == splits[i].start0 + 1) { // we directly handle problems of size 1 here
 					assignment[splits[i].start0] = nearest_neighbor_assignment[splits[i].start0];
-					sliced_earth_mover_distance += cost(hist1[splits[i].start0], hist2[nearest_neighbor_assignment[splits[i].start0]]);
+					emd += Cost::cost(hist1[splits[i].start0], hist2[nearest_neighbor_assignment[splits[i].start0]]);
+					SPOT_TRANSPORT_STATS(stats.size_one_splits++;)
 				}
 				else
 					todo.push_back(splits[i]);
@@ -697,41 +2273,92 @@ public:
 		}
 		else {
 			todo.push_back(initial_parameters);
+			SPOT_TRANSPORT_STATS(stats.slices_not_split++;)
 		}
-
-		// For all sub-problems which couldn't be matched above, solve them :
-	#pragma omp parallel for schedule(dynamic)
-		for (int i = 0; i < todo.size(); i++) {
-
-			params p = todo[i];
-
-			nearest_neighbor_match(hist1, hist2, p, nearest_neighbor_assignment); // since the bounds of the problem have changed, the NN maps has changed as well
-			// Attempt to reduce the ranges of problems. If all the histogram is matched, skip to the next one !
-			int ret = handle_simple_cases(p, hist1, hist2, &assignment[0], &nearest_neighbor_assignment[0], sliced_earth_mover_distance);
-			if (ret == 1) continue;
-
-			// Compute the number of non-injective values for the current assignment map
-			int nbbij = 0;
-			// FIXME : This should be another index, or at least keep in mind the position of the todo list above !!!
-			for (int i = p.start0 + 1; i < p.end0; i++) {
-				if (nearest_neighbor_assignment[i] == nearest_neighbor_assignment[i - 1]) nbbij++;
+		SPOT_TRANSPORT_STATS(
+			stats.subproblems += todo.size();
+			for (const params& sub : todo) {
+				stats.add_subproblem_size(sub.end0 - sub.start0);
 			}
+		)
+		return false;
+	}
 
-			// Attempt to reduce the ranges of problems. If all the histogram is matched, skip to the next one !
-			ret = reduce_range(hist1, hist2, assignment, p, sliced_earth_mover_distance, &nearest_neighbor_assignment[0], nbbij);
-			if (ret == 1) continue;
+	/// @brief Solves one of the sub-problems found by decompose_slice().
+	/// @param p The bounds of the sub-problem to solve.
+	/// @param hist1 The source distribution, projected along a random direction.
+	/// @param hist2 The target distribution, projected along the same random direction.
+	/// @param assignment The assignment of the slice, filled in on the range of the sub-problem.
+	/// @param nearest_neighbor_assignment The nearest-neighbor assignment of the slice, updated on the range of the sub-problem.
+	/// @param value The sliced EMD distance, added to with the cost of the sub-problem.
+	/// @param scratch The scratch buffers of the calling thread.
+	/// @param approximation If non-null, large sub-problems are approximated by quantile_interpolation_solve() instead of being
+	/// solved by simple_solve().
+	/// @param bound If approximation is non-null, added to with the bound on the extra cost of the approximation.
+	template<typename T, typename Cost = SquaredCost>
+	void solve_subproblem(params p, const T *hist1, const T* hist2, std::vector<int> &assignment, std::vector<int> &nearest_neighbor_assignment, T& value, TransportScratch<T>& scratch,
+						  const QuantileApproximation* approximation = nullptr, T* bound = nullptr) {
+		nearest_neighbor_match<T, Cost>(hist1, hist2, p, nearest_neighbor_assignment); // since the bounds of the problem have changed, the NN maps has changed as well
+		// Attempt to reduce the ranges of problems. If all the histogram is matched, skip to the next one !
+		int ret = handle_simple_cases<T, Cost>(p, hist1, hist2, &assignment[0], &nearest_neighbor_assignment[0], value);
+		if (ret == 1) {
+			SPOT_TRANSPORT_STATS(record_simple_case(p, scratch.stats);)
+			return;
+		}
 
-			// Handle the 'simple' cases in the current version of the assignment. If all the histogram is matched, go to the next one !
-			ret = handle_simple_cases(p, hist1, hist2, &assignment[0], &nearest_neighbor_assignment[0], sliced_earth_mover_distance);
-			if (ret == 1) continue;
+		// Compute the number of non-injective values for the current assignment map
+		int nbbij = 0;
+		for (int i = p.start0 + 1; i < p.end0; i++) {
+			if (nearest_neighbor_assignment[i] == nearest_neighbor_assignment[i - 1]) nbbij++;
+		}
 
-			// Perform a final nearest-neighbor match, and solve the problem here !
-			nearest_neighbor_match(hist1, hist2, p, nearest_neighbor_assignment); // since the bounds of the problem have changed, the NN maps has changed as well
-			simple_solve(p, hist1, hist2, &assignment[0], &nearest_neighbor_assignment[0], sliced_earth_mover_distance);
+		// Attempt to reduce the ranges of problems. If all the histogram is matched, skip to the next one !
+		ret = reduce_range<T, Cost>(hist1, hist2, assignment, p, value, &nearest_neighbor_assignment[0], nbbij);
+		if (ret == 1) {
+			SPOT_TRANSPORT_STATS(scratch.stats.solved_by_reduce_range++;)
+			return;
 		}
 
+		// Handle the 'simple' cases in the current version of the assignment. If all the histogram is matched, go to the next one !
+		ret = handle_simple_cases<T, Cost>(p, hist1, hist2, &assignment[0], &nearest_neighbor_assignment[0], value);
+		if (ret == 1) {
+			SPOT_TRANSPORT_STATS(record_simple_case(p, scratch.stats);)
+			return;
+		}
 
-		return sliced_earth_mover_distance;
+		// Perform a final nearest-neighbor match, and solve the problem here !
+		nearest_neighbor_match<T, Cost>(hist1, hist2, p, nearest_neighbor_assignment); // since the bounds of the problem have changed, the NN maps has changed as well
+		// Approximate large problems, keeping room for the exact ends and for the grid :
+		if (approximation && p.end0 - p.start0 > std::max(2 * approximation->refine + 2, 4 * approximation->grid)) {
+			quantile_interpolation_solve<T, Cost>(p, hist1, hist2, assignment, nearest_neighbor_assignment, value, scratch, *approximation, *bound);
+			SPOT_TRANSPORT_STATS(scratch.stats.solved_approximately++;)
+			return;
+		}
+		simple_solve<T, Cost>(p, hist1, hist2, &assignment[0], &nearest_neighbor_assignment[0], value, scratch);
+		SPOT_TRANSPORT_STATS(
+			scratch.stats.solved_by_simple_solve++;
+			if (p.end0 - p.start0 > scratch.stats.largest_simple_solve_M) {
+				scratch.stats.largest_simple_solve_M = p.end0 - p.start0;
+				scratch.stats.largest_simple_solve_N = p.end1 - p.start1;
+			}
+		)
+	}
+
+	/// @brief Counts a sub-problem solved by handle_simple_cases() under the case it was solved by.
+	/// @param p The bounds of the sub-problem, as passed to handle_simple_cases().
+	/// @param stats The counters to add to.
+	static void record_simple_case(const params &p, micro_benchmarks::TransportStats &stats) {
+		const int M = p.end0 - p.start0;
+		const int N = p.end1 - p.start1;
+		if (M == N) {
+			stats.solved_equal_sizes++;
+		} else if (M == N - 1) {
+			stats.solved_one_free_target++;
+		} else if (M == 1) {
+			stats.solved_single_source++;
+		} else {
+			stats.solved_injective_nearest_neighbors++;
+		}
 	}
 
 	/// @brief Puts into correspondance two distributions by 1D-sliced-optimal-transport.
@@ -743,9 +2370,17 @@ public:
 	/// @param cloud2 The second distribution, which cloud1 will be matched to.
 	/// @param niter The number of iterations/1D-slices to perform for this matching/gradient descent.
 	/// @param advect If true, matches the distributions together. If false, computes barycenters or sliced Earth Mover's Distance (EMD).
+	/// @param workspace If non-null, the buffers used by transport1d() and the sorts. Pass the same workspace across calls to avoid
+	/// re-allocating them, and to warm-start the sorts of each slice from the previous call (see warm_sort_projections()).
+	/// @param keys The precision of the projections. ProjectionKeys::quantized16 trades an error of at most
+	/// quantized_key_error() on each projection for less memory traffic : see quantized_correspondencesNd().
+	/// @param approximation If non-null, the slices are solved by approximate_transport1d() with these settings, and the
+	/// bound on the extra sliced distance this returns is stored in approximation->extra_cost_bound.
+	/// @tparam Cost The ground cost policy of the 1D transports (see cost_policies.h).
 	/// @returns The sliced Wasserstein distance. If the point clouds are modified, they are done in-place directly in the variables passed to the function.
-	template<int DIM, typename T>
-	double correspondencesNd(std::vector<Point<DIM, T> > &cloud1, const std::vector<Point<DIM, T> > &cloud2, int niter, bool advect = false) {
+	template<int DIM, typename T, typename Cost = SquaredCost>
+	double correspondencesNd(std::vector<Point<DIM, T> > &cloud1, const std::vector<Point<DIM, T> > &cloud2, int niter, bool advect = false, TransportWorkspace<T>* workspace = nullptr,
+							 ProjectionKeys keys = ProjectionKeys::full, QuantileApproximation* approximation = nullptr) {
 		// advect = true : used for matching one distrib to another such as in our FIST
 		//                 algorithm. This function will advect cloud1 to cloud2 along
 		//                 a sliced wasserstein flow
@@ -753,70 +2388,281 @@ public:
 		//                 any stochastic gradient descent then, this will merely compute
 		//                 the sliced wasserstein distance).
 
+		const ThreadCountScope threads(this->num_threads);
+		if (keys == ProjectionKeys::quantized16) {
+			TransportWorkspace<T> local_workspace;
+			return quantized_correspondencesNd<DIM, T, Cost>(cloud1, cloud2, niter, advect, workspace ? *workspace : local_workspace, approximation);
+		}
+
+		return sliced_correspondences<DIM, T, Cost>(cloud1, cloud2, niter, advect, workspace, approximation);
+	}
+
+	/// @brief correspondencesNd() on point clouds stored by coordinate, which makes projecting and advecting them faster.
+	/// @details Both clouds must not be re-allocated between calls sharing the sorted projections of cloud2 through
+	/// workspace->target_projections. Projections are not quantized : see correspondencesNd() for the other parameters.
+	template<int DIM, typename T, typename Cost = SquaredCost>
+	double correspondencesNd(PointCloud<DIM, T> &cloud1, const PointCloud<DIM, T> &cloud2, int niter, bool advect = false, TransportWorkspace<T>* workspace = nullptr,
+							 QuantileApproximation* approximation = nullptr) {
+		const ThreadCountScope threads(this->num_threads);
+		return sliced_correspondences<DIM, T, Cost>(cloud1, cloud2, niter, advect, workspace, approximation);
+	}
+
+	/// @brief The slices of correspondencesNd(), on clouds stored either as vectors of points or as PointCloud.
+	template<int DIM, typename T, typename Cost, typename Cloud1, typename Cloud2>
+	double sliced_correspondences(Cloud1 &cloud1, const Cloud2 &cloud2, int niter, bool advect, TransportWorkspace<T>* workspace, QuantileApproximation* approximation) {
+		if (!advect && approximation == nullptr) {
+			// Slices are independent then : solve them in batches to keep all threads busy.
+			return batched_sliced_distance<DIM, T, Cost>(cloud1, cloud2, niter, 0, workspace);
+		}
+		if (advect && approximation == nullptr && this->advection_batch > 1) {
+			return batched_advection<DIM, T, Cost>(cloud1, cloud2, niter, workspace);
+		}
+
 		Point<DIM, T> dir; ///< Stores the current direction points are projected along.
-		// we won't use the indices here for the moment nor the assignment, so if memory is an issue, we can remove the variables below
-		std::vector<std::pair<T, int>> cloud1Idx(cloud1.size());
-		std::vector<std::pair<T, int>> cloud2Idx(cloud2.size());
+		std::vector<T> projections1(cloud1.size()), projections2(cloud2.size());
+		std::vector<int> order1(cloud1.size()), order2(cloud2.size());
 		T* projHist1 = (T*)malloc_simd(cloud1.size() * sizeof(T), 32);
 		T* projHist2 = (T*)malloc_simd(cloud2.size() * sizeof(T), 32);
 		//std::vector<Point<DIM, T>> deltas(cloud1.size(), Point<DIM, T>());
 
 		engine.seed(10);
 
+		TransportWorkspace<T> local_workspace;
+		if (workspace == nullptr) {
+			workspace = &local_workspace;
+		}
+		workspace->reserve(cloud1.size(), cloud2.size());
+		workspace->sorted_order1.reserve(niter);
+		workspace->sorted_order2.reserve(niter);
+
 		std::vector<int> corr1d;
 		double d = 0;
+		double bound = 0;
+		DirectionGenerator<DIM, T> directions(this->direction_sampling, niter);
 		for (int iter = 0; iter < niter; iter++) { // number of random slices
 
-			// Choose one random direction, in n-dimensions. BoxMuller returns a random 2D point, and its
-			// coordinates are copied into the direction's fields. It is then normalized.
-			double n = 0;
-			for (int i = 0; i < DIM; i+=2) {
-				Point<2, double> randGauss = BoxMuller<double>();
-				dir[i] = randGauss[0];
-				n += dir[i] * dir[i];
-				if (i < DIM-1) {
-					dir[i+1] = randGauss[1];
-					n += dir[i+1] * dir[i+1];
+			// Choose one direction, in n-dimensions.
+			dir = directions.next();
+
+			// Sort both clouds according to their projection on the current direction, by projection then by index. The
+			// directions are the same on every call : the sorts start from the permutations of the previous call (see
+			// warm_sort_projections()), and the ones of a fixed cloud2 may be cached altogether.
+			Projector<DIM, T> proj(dir);
+			proj.project(cloud1, projections1.data());
+			warm_sort_projections(projections1.data(), cloud1.size(), projHist1, order1.data(), workspace->sort, workspace->sorted_order1, iter);
+
+			const T* sortedHist2 = workspace->target_projections ? workspace->target_projections->find(cloud2.data(), cloud2.size(), this->direction_sampling, niter, iter) : nullptr;
+			if (sortedHist2 == nullptr) {
+				proj.project(cloud2, projections2.data());
+				warm_sort_projections(projections2.data(), cloud2.size(), projHist2, order2.data(), workspace->sort, workspace->sorted_order2, iter);
+				if (workspace->target_projections) {
+					workspace->target_projections->store(iter, projHist2);
 				}
+				sortedHist2 = projHist2;
 			}
-			n = std::sqrt(n);
-			for (int i = 0; i < DIM; i++) {
-				dir[i] /= n;
+
+			T emd = correspondence_slice<T, Cost>(projHist1, sortedHist2, cloud1.size(), cloud2.size(), corr1d, *workspace, approximation, bound);
+
+			d += emd;
+
+
+			if (advect) {
+				// The projections are sorted : their buffer holds the displacement of each sample along dir, scattered
+				// once, so that the samples are then moved in order.
+				for (int i = 0; i < cloud1.size(); i++) {
+					projections1[order1[i]] = sortedHist2[corr1d[i]] - projHist1[i];
+				}
+				displace_samples(cloud1, projections1.data(), dir);
 			}
+		}
 
-			// Sort both clouds according to their projection on the current direction :
-			Projector<DIM, T> proj(dir);
-			for (int i = 0; i < cloud1.size(); i++) {
-				cloud1Idx[i] = std::make_pair(proj.proj(cloud1[i]), i);
+		free_simd(projHist1);
+		free_simd(projHist2);
+
+		if (approximation) {
+			approximation->extra_cost_bound = bound*2.0/niter;
+		}
+		return d*2.0/niter;
+	}
+
+	/// @brief The advection of correspondencesNd() by batches of advection_batch slices, solved in parallel.
+	/// @details The slices of a batch are projected, sorted and solved against the same cloud1, and cloud1 is then moved
+	/// by the average of their displacements times DIM (at most their sum), as the barycenters do : with random
+	/// directions, the displacement along K directions is K/DIM of the displacement in DIM dimensions. The directions,
+	/// warm-started sorts and cached projections of cloud2 are the ones of the sequential advection.
+	/// @returns The sliced Wasserstein distance, summed over slices of the successive states of cloud1.
+	template<int DIM, typename T, typename Cost, typename Cloud1, typename Cloud2>
+	double batched_advection(Cloud1 &cloud1, const Cloud2 &cloud2, int niter, TransportWorkspace<T>* workspace) {
+		const int M = static_cast<int>(cloud1.size());
+		const int N = static_cast<int>(cloud2.size());
+		const int batch_size = std::max(1, std::min(this->advection_batch, niter));
+		const T step = static_cast<T>(std::min(1.0, static_cast<double>(DIM) / batch_size));
+
+		std::vector<Point<DIM, T> > dirs(batch_size);
+		// The projections and sorted projections of each slice of the batch, and sort buffers of each thread :
+		std::vector<std::vector<T> > projections1(batch_size, std::vector<T>(M)), projections2(batch_size, std::vector<T>(N));
+		std::vector<std::vector<int> > order1(batch_size, std::vector<int>(M));
+		std::vector<std::vector<int> > order2(omp_get_max_threads(), std::vector<int>(N));
+		std::vector<RadixSortWorkspace<T> > sort_workspaces(omp_get_max_threads());
+		std::vector<T*> projHist1(batch_size), projHist2(batch_size);
+		for (int k = 0; k < batch_size; k++) {
+			projHist1[k] = (T*)malloc_simd(M * sizeof(T), 32);
+			projHist2[k] = (T*)malloc_simd(N * sizeof(T), 32);
+		}
+		std::vector<const T*> hist1, hist2(batch_size);
+		std::vector<int> M0, N0;
+		std::vector<std::vector<int> > corr1d;
+		std::vector<T> emds;
+
+		engine.seed(10);
+
+		TransportWorkspace<T> local_workspace;
+		if (workspace == nullptr) {
+			workspace = &local_workspace;
+		}
+		if (!workspace->batch) {
+			workspace->batch.reset(new TransportBatchWorkspace<T>());
+		}
+		TransportBatchWorkspace<T>& batch_workspace = *workspace->batch;
+		workspace->sorted_order1.reserve(niter);
+		workspace->sorted_order2.reserve(niter);
+		SortedProjectionCache<T>* target_projections = workspace->target_projections;
+
+		double d = 0;
+		DirectionGenerator<DIM, T> directions(this->direction_sampling, niter);
+		for (int first = 0; first < niter; first += batch_size) {
+			const int K = std::min(batch_size, niter - first);
+			// The cache of projections is not thread-safe : it is read before the parallel loop, and written after it.
+			for (int k = 0; k < K; k++) {
+				dirs[k] = directions.next();
+				hist2[k] = target_projections ? target_projections->find(cloud2.data(), N, this->direction_sampling, niter, first + k) : nullptr;
 			}
-			for (int i = 0; i < cloud2.size(); i++) {
-				cloud2Idx[i] = std::make_pair(proj.proj(cloud2[i]), i);
+
+		#pragma omp parallel for schedule(dynamic)
+			for (int k = 0; k < K; k++) {
+				const int thread_num = omp_get_thread_num();
+				Projector<DIM, T> proj(dirs[k]);
+				proj.project(cloud1, projections1[k].data());
+				warm_sort_projections(projections1[k].data(), M, projHist1[k], order1[k].data(), sort_workspaces[thread_num], workspace->sorted_order1, first + k);
+				if (hist2[k] == nullptr) {
+					proj.project(cloud2, projections2[k].data());
+					warm_sort_projections(projections2[k].data(), N, projHist2[k], order2[thread_num].data(), sort_workspaces[thread_num], workspace->sorted_order2, first + k);
+				}
+			}
+			for (int k = 0; k < K; k++) {
+				if (hist2[k] == nullptr) {
+					if (target_projections) {
+						target_projections->store(first + k, projHist2[k]);
+					}
+					hist2[k] = projHist2[k];
+				}
 			}
 
-			// Sort both distributions.
-			// WARNING : By default, std::pair<> sorts based on lexicographical order : compare the first element, then the second.
-			std::thread mythread( [&]{std::sort(cloud1Idx.begin(), cloud1Idx.end()); } );
-			std::sort(cloud2Idx.begin(), cloud2Idx.end());
-            mythread.join();
+			hist1.assign(projHist1.begin(), projHist1.begin() + K);
+			M0.assign(K, M);
+			N0.assign(K, N);
+			transport1d_batch<T, Cost>(hist1, std::vector<const T*>(hist2.begin(), hist2.begin() + K), M0, N0, corr1d, emds, batch_workspace);
 
-			for (int i = 0; i < cloud1.size(); i++) {
-				projHist1[i] = cloud1Idx[i].first;
+			// The projections are sorted : their buffers hold the displacement of each sample along each direction.
+		#pragma omp parallel for schedule(static)
+			for (int k = 0; k < K; k++) {
+				for (int i = 0; i < M; i++) {
+					projections1[k][order1[k][i]] = step * (hist2[k][corr1d[k][i]] - projHist1[k][i]);
+				}
 			}
-			for (int i = 0; i < cloud2.size(); i++) {
-				projHist2[i] = cloud2Idx[i].first;
+			for (int k = 0; k < K; k++) {
+				d += emds[k];
+				displace_samples(cloud1, projections1[k].data(), dirs[k]);
 			}
+		}
+		SPOT_TRANSPORT_STATS(
+			workspace->stats.merge(batch_workspace.stats);
+			batch_workspace.stats.reset();
+		)
+
+		for (int k = 0; k < batch_size; k++) {
+			free_simd(projHist1[k]);
+			free_simd(projHist2[k]);
+		}
+
+		return d*2.0/niter;
+	}
 
+	/// @brief Solves one slice of correspondencesNd() : exactly, or by approximate_transport1d() if approximation is non-null.
+	/// @param bound Added to with the bound on the extra cost of the approximation.
+	template<typename T, typename Cost = SquaredCost>
+	T correspondence_slice(const T *hist1, const T* hist2, int M0, int N0, std::vector<int> &assignment, TransportWorkspace<T>& workspace,
+						   const QuantileApproximation* approximation, double &bound) {
+		if (approximation == nullptr) {
+			return transport1d<T, Cost>(hist1, hist2, M0, N0, assignment, workspace);
+		}
+		T slice_bound;
+		const T emd = approximate_transport1d<T, Cost>(hist1, hist2, M0, N0, assignment, *approximation, slice_bound, workspace);
+		bound += slice_bound;
+		return emd;
+	}
 
-			T emd = transport1d(projHist1, projHist2, cloud1.size(), cloud2.size(), corr1d);
+	/// @brief correspondencesNd() on projections quantized to 16-bit keys.
+	/// @details On each slice, the projections are quantized with a KeyQuantizer over the projection of the bounding box of
+	/// both clouds, and sorted with counting_sort() (see sort_quantized_projections()). This replaces the (projection, index)
+	/// pairs and their radix sort by 2-byte keys, 4-byte indices and a single counting pass. The 1D transport and the advection use the dequantized keys,
+	/// in the samples' type : every projection is off by at most quantized_key_error(cloud1, cloud2).
+	/// @see correspondencesNd()
+	template<int DIM, typename T, typename Cost = SquaredCost>
+	double quantized_correspondencesNd(std::vector<Point<DIM, T> > &cloud1, const std::vector<Point<DIM, T> > &cloud2, int niter, bool advect, TransportWorkspace<T>& workspace,
+									   QuantileApproximation* approximation = nullptr) {
+		const int M = static_cast<int>(cloud1.size());
+		const int N = static_cast<int>(cloud2.size());
+		std::vector<uint16_t> keys1(M);
+		std::vector<uint16_t> keys2(N);
+		std::vector<int> order1(M);
+		std::vector<int> order2(N);
+		T* projHist1 = (T*)malloc_simd(M * sizeof(T), 32);
+		T* projHist2 = (T*)malloc_simd(N * sizeof(T), 32);
+
+		// cloud2 does not move : only the box of cloud1 is updated, while advecting it.
+		BoundingBox<DIM, T> box1, box2;
+		box1.add(cloud1);
+		box2.add(cloud2);
 
-			d += emd;
+		engine.seed(10);
+		workspace.reserve(M, N);
+
+		std::vector<int> corr1d;
+		double d = 0;
+		double bound = 0;
+		DirectionGenerator<DIM, T> directions(this->direction_sampling, niter);
+		for (int iter = 0; iter < niter; iter++) {
+			Point<DIM, T> dir = directions.next();
 
+			BoundingBox<DIM, T> box = box1;
+			box.add(box2);
+			double lo, hi;
+			box.projection_range(dir, lo, hi);
+			const KeyQuantizer<T> quantizer(lo, hi);
+
+			// Each cloud is projected, quantized and sorted by all the threads of the OpenMP team.
+			sort_quantized_projections(cloud1, dir, quantizer, keys1.data(), projHist1, order1.data(), workspace.key_sort);
+			sort_quantized_projections(cloud2, dir, quantizer, keys2.data(), projHist2, order2.data(), workspace.key_sort);
+
+			d += correspondence_slice<T, Cost>(projHist1, projHist2, M, N, corr1d, workspace, approximation, bound);
 
 			if (advect) {
-				for (int i = 0; i < cloud1Idx.size(); i++) {
-					for (int j = 0; j < DIM; j++) {
-						cloud1[cloud1Idx[i].second][j] += (projHist2[corr1d[i]] - projHist1[i])*dir[j];
+				// Each thread bounds the samples it moves : the box is the same for any number of threads.
+				box1 = BoundingBox<DIM, T>();
+			#pragma omp parallel if(M >= radix_sort_parallel_size)
+				{
+					BoundingBox<DIM, T> thread_box;
+				#pragma omp for schedule(static)
+					for (int i = 0; i < M; i++) {
+						Point<DIM, T> &p = cloud1[order1[i]];
+						for (int j = 0; j < DIM; j++) {
+							p[j] += (projHist2[corr1d[i]] - projHist1[i])*dir[j];
+						}
+						thread_box.add(p);
 					}
+				#pragma omp critical(spot_quantized_box)
+					box1.add(thread_box);
 				}
 			}
 		}
@@ -824,11 +2670,221 @@ public:
 		free_simd(projHist1);
 		free_simd(projHist2);
 
+		if (approximation) {
+			approximation->extra_cost_bound = bound*2.0/niter;
+		}
+		return d*2.0/niter;
+	}
+
+	/// @brief correspondencesNd() for weighted diracs : each sample of cloud1 and cloud2 carries a mass.
+	/// @details Only the distinct samples are projected, sorted and advected : see collapse_duplicates() to build them
+	/// from a cloud with repeated samples. The slices are solved by weighted_transport1d(), and each sample of cloud1 is
+	/// advected to the barycentric projection of its mass (see barycentric_projection()). With integer masses, the
+	/// sliced distance is the one of correspondencesNd() on the clouds with duplicated samples.
+	/// @tparam DIM The dimensionality of the point clouds to match.
+	/// @tparam T The data type of the distributions' samples.
+	/// @param cloud1 The first distribution, to register to cloud2.
+	/// @param mass1 The mass of each sample of cloud1.
+	/// @param cloud2 The second distribution, which cloud1 will be matched to.
+	/// @param mass2 The mass of each sample of cloud2. Its total must not be less than the one of mass1.
+	/// @param niter The number of iterations/1D-slices to perform for this matching/gradient descent.
+	/// @param advect If true, matches the distributions together. If false, only computes the sliced EMD.
+	/// @param workspace If non-null, the buffers used by weighted_transport1d(), to reuse across calls.
+	/// @tparam Cost The ground cost policy of the 1D transports (see cost_policies.h).
+	/// @returns The sliced Wasserstein distance.
+	template<int DIM, typename T, typename Cost = SquaredCost>
+	double weighted_correspondencesNd(std::vector<Point<DIM, T> > &cloud1, const std::vector<T> &mass1, const std::vector<Point<DIM, T> > &cloud2, const std::vector<T> &mass2,
+									  int niter, bool advect = false, WeightedTransportWorkspace<T>* workspace = nullptr) {
+		const ThreadCountScope threads(this->num_threads);
+		const int M = static_cast<int>(cloud1.size());
+		const int N = static_cast<int>(cloud2.size());
+		std::vector<T> projections1(M), projections2(N), projHist1(M), projHist2(N), sortedMass1(M), sortedMass2(N), targets;
+		std::vector<int> order1(M), order2(N);
+		RadixSortWorkspace<T> sort_workspace;
+		std::vector<TransportPlanEntry<T>> plan;
+
+		WeightedTransportWorkspace<T> local_workspace;
+		if (workspace == nullptr) {
+			workspace = &local_workspace;
+		}
+
+		engine.seed(10);
+
+		double d = 0;
+		DirectionGenerator<DIM, T> directions(this->direction_sampling, niter);
+		for (int iter = 0; iter < niter; iter++) {
+			Point<DIM, T> dir = directions.next();
+
+			Projector<DIM, T> proj(dir);
+			for (int i = 0; i < M; i++) {
+				projections1[i] = proj.proj(cloud1[i]);
+			}
+			for (int i = 0; i < N; i++) {
+				projections2[i] = proj.proj(cloud2[i]);
+			}
+			radix_sort_projections(projections1.data(), M, projHist1.data(), order1.data(), sort_workspace);
+			radix_sort_projections(projections2.data(), N, projHist2.data(), order2.data(), sort_workspace);
+
+			for (int i = 0; i < M; i++) {
+				sortedMass1[i] = mass1[order1[i]];
+			}
+			for (int i = 0; i < N; i++) {
+				sortedMass2[i] = mass2[order2[i]];
+			}
+
+			d += weighted_transport1d<T, Cost>(projHist1.data(), sortedMass1.data(), M, projHist2.data(), sortedMass2.data(), N, plan, *workspace);
+
+			if (advect) {
+				barycentric_projection(plan, projHist1.data(), projHist2.data(), M, targets);
+				for (int i = 0; i < M; i++) {
+					for (int j = 0; j < DIM; j++) {
+						cloud1[order1[i]][j] += (targets[i] - projHist1[i])*dir[j];
+					}
+				}
+			}
+		}
+
 		return d*2.0/niter;
 	}
 
-	template<int DIM, typename T>  // Mbary should be less than min_i(bary[i].size())
-	void unbalanced_barycenter(int Mbary, int niters, int nslices, const std::vector<T> &weights, const std::vector< std::vector<Point<DIM, T> > > &points, std::vector<Point<DIM, T> > &barycenter) {
+	/// @brief Computes the sliced partial Wasserstein distance between two distributions, without modifying them.
+	/// @details Draws the same directions as correspondencesNd(), but projects, sorts and solves the slices in batches of
+	/// batch_size slices at once with transport1d_batch().
+	/// @tparam DIM The dimensionality of the point clouds.
+	/// @tparam T The data type of the distributions' samples.
+	/// @param cloud1 The first distribution.
+	/// @param cloud2 The second distribution.
+	/// @param niter The number of 1D-slices to perform.
+	/// @param batch_size The number of slices solved at once. If 0, as many as fit in batch_slices_max_bytes.
+	/// @param workspace If non-null, the buffers to reuse across calls, the previous sorts of each slice to warm-start
+	/// from and the cache of the sorted projections of cloud2 (see correspondencesNd()).
+	/// @tparam Cost The ground cost policy of the 1D transports (see cost_policies.h).
+	/// @returns The sliced Wasserstein distance.
+	template<int DIM, typename T, typename Cost = SquaredCost>
+	double sliced_distance(const std::vector<Point<DIM, T> > &cloud1, const std::vector<Point<DIM, T> > &cloud2, int niter, int batch_size = 0, TransportWorkspace<T>* workspace = nullptr) {
+		const ThreadCountScope threads(this->num_threads);
+		return batched_sliced_distance<DIM, T, Cost>(cloud1, cloud2, niter, batch_size, workspace);
+	}
+
+	/// @brief sliced_distance() on point clouds stored by coordinate.
+	template<int DIM, typename T, typename Cost = SquaredCost>
+	double sliced_distance(const PointCloud<DIM, T> &cloud1, const PointCloud<DIM, T> &cloud2, int niter, int batch_size = 0, TransportWorkspace<T>* workspace = nullptr) {
+		const ThreadCountScope threads(this->num_threads);
+		return batched_sliced_distance<DIM, T, Cost>(cloud1, cloud2, niter, batch_size, workspace);
+	}
+
+	/// @brief The batches of sliced_distance(), on clouds stored either as vectors of points or as PointCloud.
+	template<int DIM, typename T, typename Cost, typename Cloud1, typename Cloud2>
+	double batched_sliced_distance(const Cloud1 &cloud1, const Cloud2 &cloud2, int niter, int batch_size, TransportWorkspace<T>* workspace) {
+		const int M = static_cast<int>(cloud1.size());
+		const int N = static_cast<int>(cloud2.size());
+		if (batch_size <= 0) {
+			// Each slice of a batch holds the projections and sorted projections of both clouds, and two assignments.
+			const std::size_t slice_bytes = 2 * (static_cast<std::size_t>(M) + N) * sizeof(T) + 2 * static_cast<std::size_t>(M) * sizeof(int);
+			batch_size = static_cast<int>(std::min<std::size_t>(batch_slices_max_bytes / std::max<std::size_t>(slice_bytes, 1), std::max(niter, 1)));
+		}
+		batch_size = std::max(1, std::min(batch_size, niter));
+		const int nthreads = omp_get_max_threads();
+
+		TransportWorkspace<T> local_workspace;
+		if (workspace == nullptr) {
+			workspace = &local_workspace;
+		}
+		if (!workspace->batch) {
+			workspace->batch.reset(new TransportBatchWorkspace<T>());
+		}
+		TransportBatchWorkspace<T>& batch = *workspace->batch;
+		workspace->sorted_order1.reserve(niter);
+		workspace->sorted_order2.reserve(niter);
+		SortedProjectionCache<T>* target_projections = workspace->target_projections;
+
+		// The projections of each slice of the batch, and sort buffers of each thread, grown to this call :
+		if (static_cast<int>(batch.projections1.size()) < batch_size) {
+			batch.projections1.resize(batch_size);
+			batch.projections2.resize(batch_size);
+			batch.sorted1.resize(batch_size);
+			batch.sorted2.resize(batch_size);
+		}
+		if (static_cast<int>(batch.orders.size()) < nthreads) {
+			batch.orders.resize(nthreads);
+			batch.sorts.resize(nthreads);
+		}
+		std::vector<T*> projections1_ptr(batch_size), projections2_ptr(batch_size);
+		for (int k = 0; k < batch_size; k++) {
+			batch.projections1[k].resize(M);
+			batch.projections2[k].resize(N);
+			projections1_ptr[k] = batch.projections1[k].data();
+			projections2_ptr[k] = batch.projections2[k].data();
+			batch.sorted1[k].reserve(M);
+			batch.sorted2[k].reserve(N);
+		}
+		for (int t = 0; t < nthreads; t++) {
+			batch.orders[t].resize(std::max(M, N));
+		}
+		std::vector<Point<DIM, T> > dirs(batch_size);
+		std::vector<const T*> hist1(batch_size), hist2(batch_size);
+		std::vector<int> M0, N0;
+
+		engine.seed(10);
+
+		double d = 0;
+		DirectionGenerator<DIM, T> directions(this->direction_sampling, niter);
+		for (int first = 0; first < niter; first += batch_size) {
+			const int K = std::min(batch_size, niter - first);
+			// Directions are drawn sequentially, to get the same ones as correspondencesNd(). The cache of projections is
+			// not thread-safe : it is read before the parallel loop, and written after it.
+			bool project2 = false;
+			for (int k = 0; k < K; k++) {
+				dirs[k] = directions.next();
+				hist1[k] = batch.sorted1[k].data;
+				hist2[k] = target_projections ? target_projections->find(cloud2.data(), N, this->direction_sampling, niter, first + k) : nullptr;
+				project2 |= hist2[k] == nullptr;
+			}
+
+			const BatchProjector<DIM, T> projector(dirs.data(), K);
+			projector.project(cloud1, projections1_ptr.data());
+			if (project2) {
+				projector.project(cloud2, projections2_ptr.data());
+			}
+
+		#pragma omp parallel for schedule(dynamic)
+			for (int k = 0; k < K; k++) {
+				const int thread_num = omp_get_thread_num();
+				warm_sort_projections(projections1_ptr[k], M, batch.sorted1[k].data, batch.orders[thread_num].data(), batch.sorts[thread_num], workspace->sorted_order1, first + k);
+				if (hist2[k] == nullptr) {
+					warm_sort_projections(projections2_ptr[k], N, batch.sorted2[k].data, batch.orders[thread_num].data(), batch.sorts[thread_num], workspace->sorted_order2, first + k);
+				}
+			}
+			for (int k = 0; k < K; k++) {
+				if (hist2[k] == nullptr) {
+					if (target_projections) {
+						target_projections->store(first + k, batch.sorted2[k].data);
+					}
+					hist2[k] = batch.sorted2[k].data;
+				}
+			}
+
+			M0.assign(K, M);
+			N0.assign(K, N);
+			transport1d_batch<T, Cost>(std::vector<const T*>(hist1.begin(), hist1.begin() + K), std::vector<const T*>(hist2.begin(), hist2.begin() + K),
+									   M0, N0, batch.assignments, batch.emds, batch);
+			for (int k = 0; k < K; k++) {
+				d += batch.emds[k];
+			}
+		}
+		SPOT_TRANSPORT_STATS(
+			workspace->stats.merge(batch.stats);
+			batch.stats.reset();
+		)
+
+		return d*2.0/niter;
+	}
+
+	/// @brief Computes the sliced barycenter of Mbary samples of the clouds points, with the weights weights.
+	/// @return The cost and displacement of each iteration : fewer than niters if it converged (see barycenter_tolerance).
+	template<int DIM, typename T, typename Cost = SquaredCost>  // Mbary should be less than min_i(bary[i].size())
+	BarycenterTrace unbalanced_barycenter(int Mbary, int niters, int nslices, const std::vector<T> &weights, const std::vector< std::vector<Point<DIM, T> > > &points, std::vector<Point<DIM, T> > &barycenter) {
+		const ThreadCountScope threads(this->num_threads);
 		auto start = std::chrono::system_clock::now();
 
 		barycenter.resize(Mbary);
@@ -844,107 +2900,340 @@ public:
 		srand(10);
 		engine.seed(10);
 		std::vector<Point<DIM, T> > dirs(nslices);
+		DirectionGenerator<DIM, T> directions(this->direction_sampling, nslices);
 		for (int slice = 0; slice < nslices; slice++) {
-			if (DIM == 2) {
+			if (DIM == 2 && this->direction_sampling == DirectionSampling::gaussian) {
 				double theta = slice * M_PI / nslices;
 				dirs[slice][0] = cos(theta);
 				dirs[slice][1] = sin(theta);
 			} else {
-				double n = 0;
-				for (int i = 0; i < DIM; i += 2) {
-					Point<2, double> randGauss = BoxMuller<double>();
-					dirs[slice][i] = randGauss[0];
-					n += dirs[slice][i] * dirs[slice][i];
-					if (i < DIM - 1) {
-						dirs[slice][i + 1] = randGauss[1];
-						n += dirs[slice][i + 1] * dirs[slice][i + 1];
-					}
-				}
-				n = std::sqrt(n);
-				for (int i = 0; i < DIM; i++) {
-					dirs[slice][i] /= n;
-				}
+				dirs[slice] = directions.next();
 			}
 		}
 
-		std::vector<T *> projHist1(omp_get_max_threads());
-		for (int i = 0; i < omp_get_max_threads(); i++)
-			projHist1[i] = (T *) malloc_simd(barycenter.size() * sizeof(T), 32);
+		// The clouds do not move : their sorted projections on the first cached_slices slices are computed once, in the
+		// first iteration, within barycenter_cache_max_bytes.
+		int max_cloud_size = 0;
+		std::size_t slice_bytes = 0;
+		for (int cloud = 0; cloud < points.size(); cloud++) {
+			max_cloud_size = std::max(max_cloud_size, static_cast<int>(points[cloud].size()));
+			slice_bytes += points[cloud].size() * sizeof(T);
+		}
+		const int cached_slices = static_cast<int>(std::min<std::size_t>(nslices, this->barycenter_cache_max_bytes / std::max<std::size_t>(slice_bytes, 1)));
+		std::vector<std::vector<std::vector<T> > > sorted_clouds(points.size(), std::vector<std::vector<T> >(cached_slices));
 
-		std::vector<std::vector<std::pair<T, int> > > cloud1Idx(omp_get_max_threads(), std::vector<std::pair<T, int> >(Mbary));
-		std::vector<std::vector<std::pair<T, int> > > cloud2Idx(omp_get_max_threads());
+		std::vector<T *> projHist2(omp_get_max_threads());
+		for (int i = 0; i < omp_get_max_threads(); i++)
+			projHist2[i] = (T *) malloc_simd(std::max(max_cloud_size, 1) * sizeof(T), 32);
+
+		std::vector<std::vector<T> > projections(omp_get_max_threads(), std::vector<T>(max_cloud_size));
+		std::vector<std::vector<int> > order2(omp_get_max_threads(), std::vector<int>(max_cloud_size));
+		std::vector<RadixSortWorkspace<T> > sort_workspaces(omp_get_max_threads());
+		std::vector<TransportWorkspace<T> > workspaces(omp_get_max_threads());
+		// The barycenter moves little between iterations : its sorts start from the previous permutation on each slice.
+		WarmSortCache barycenter_orders;
+		barycenter_orders.reserve(nslices);
+		// The barycenter does not move during an iteration : it is projected onto groups of slices at once, and sorted
+		// once on each slice for all the clouds.
+		const int group = static_cast<int>(std::max<std::size_t>(1, std::min<std::size_t>(nslices, batch_projection_max_bytes / (std::max(Mbary, 1) * sizeof(T)))));
+		std::vector<std::vector<T> > barycenter_projections(group, std::vector<T>(Mbary));
+		std::vector<T*> barycenter_projections_ptr(group);
+		std::vector<SimdBuffer<T> > sorted_barycenter(group);
+		std::vector<std::vector<int> > order1(group, std::vector<int>(Mbary));
+		for (int g = 0; g < group; g++) {
+			barycenter_projections_ptr[g] = barycenter_projections[g].data();
+			sorted_barycenter[g].reserve(std::max(Mbary, 1));
+		}
+		// Each slice writes the displacement of each sample along its direction to its own buffer, and they are summed
+		// by coordinate over the samples in parallel : no two threads update the same sample.
+		std::vector<std::vector<T> > displacements(group, std::vector<T>(Mbary));
+		PointCloud<DIM, T> offset(Mbary);
+		// The cost of each slice, summed in order : the trace does not depend on the number of threads.
+		std::vector<double> slice_costs(nslices);
+		BarycenterTrace trace;
 
 		for (int iter = 0; iter < niters; iter++) {
+			offset.set_zero();
+			std::fill(slice_costs.begin(), slice_costs.end(), 0.);
+			for (int first = 0; first < nslices; first += group) {
+				const int last = std::min(nslices, first + group);
+				BatchProjector<DIM, T>(&dirs[first], last - first).project(barycenter.data(), Mbary, barycenter_projections_ptr.data());
+				#pragma omp parallel for schedule(dynamic)
+				for (int slice = first; slice < last; slice++) {
+					const int thread_num = omp_get_thread_num();
+					warm_sort_projections(barycenter_projections_ptr[slice - first], Mbary, sorted_barycenter[slice - first].data, order1[slice - first].data(), sort_workspaces[thread_num], barycenter_orders, slice);
+				}
+				for (int cloud = 0; cloud < points.size(); cloud++) {
+					const int N = static_cast<int>(points[cloud].size());
+					#pragma omp parallel
+					{
+						int thread_num = omp_get_thread_num();
+						std::vector<int> corr1d;
+
+						#pragma omp for schedule(dynamic)
+						for (int slice = first; slice < last; slice++) { // number of random slices
+
+							Point<DIM, T> dir = dirs[slice];
+							const T* hist1 = sorted_barycenter[slice - first].data;
+							const int* sorted_order1 = order1[slice - first].data();
+
+							const T* sorted_cloud = projHist2[thread_num];
+							if (slice < cached_slices && !sorted_clouds[cloud][slice].empty()) {
+								sorted_cloud = sorted_clouds[cloud][slice].data();
+							} else {
+								T* sorted = projHist2[thread_num];
+								if (slice < cached_slices) {
+									sorted_clouds[cloud][slice].resize(N);
+									sorted = sorted_clouds[cloud][slice].data();
+								}
+								Projector<DIM, T> proj(dir);
+								T* proj_values = projections[thread_num].data();
+								for (int i = 0; i < N; i++) {
+									proj_values[i] = proj.proj(points[cloud][i]);
+								}
+								radix_sort_projections(proj_values, N, sorted, order2[thread_num].data(), sort_workspaces[thread_num]);
+								sorted_cloud = sorted;
+							}
 
-			double d = 0;
-
-			std::vector<Point<DIM, T> > offset(barycenter.size());
-			std::vector<Point<DIM, T> > newbary = barycenter;
-			for (int cloud = 0; cloud < points.size(); cloud++) {
-				#pragma omp parallel
-				{
-					int thread_num = omp_get_thread_num();
-					cloud2Idx[thread_num].resize(points[cloud].size());
-					T *projHist2 = (T *) malloc_simd(points[cloud].size() * sizeof(T), 32);
-					std::vector<int> corr1d;
-					double local_d = 0;
-
-					#pragma omp for schedule(dynamic)
-					for (int slice = 0; slice < nslices; slice++) { // number of random slices
+							transport1d<T, Cost>(hist1, sorted_cloud, Mbary, N, corr1d, workspaces[thread_num]);
 
-						Point<DIM, T> dir = dirs[slice];
+							double slice_cost = 0;
+							for (int i = 0; i < corr1d.size(); i++) {
+								slice_cost += Cost::cost(hist1[i], sorted_cloud[corr1d[i]]);
+							}
+							slice_costs[slice] += weights[cloud] * slice_cost;
 
-						// sort according to projection on direction
-						Projector<DIM, T> proj(dir);
-						for (int i = 0; i < Mbary; i++) {
-							cloud1Idx[thread_num][i] = std::make_pair(proj.proj(barycenter[i]), i);
-						}
-						for (int i = 0; i < points[cloud].size(); i++) {
-							cloud2Idx[thread_num][i] = std::make_pair(proj.proj(points[cloud][i]), i);
-						}
-						std::thread mythread([&] {
-							std::sort(cloud1Idx[thread_num].begin(), cloud1Idx[thread_num].end());
+							T* displacement = displacements[slice - first].data();
 							for (int i = 0; i < Mbary; i++) {
-								projHist1[thread_num][i] = cloud1Idx[thread_num][i].first;
+								displacement[sorted_order1[i]] = weights[cloud] * (sorted_cloud[corr1d[i]] - hist1[i]);
 							}
-						});
-
-						std::sort(cloud2Idx[thread_num].begin(), cloud2Idx[thread_num].end());
-
-						for (int i = 0; i < points[cloud].size(); i++) {
-							projHist2[i] = cloud2Idx[thread_num][i].first;
 						}
 
-						mythread.join();
-						transport1d(projHist1[thread_num], projHist2, Mbary, points[cloud].size(), corr1d);
+						add_displacements(offset, displacements, &dirs[first], last - first, nslices);
+					}
+				}
+			}
+			if (this->barycenter_iteration(trace, slice_costs, barycenter, offset)) {
+				break;
+			}
+		}
 
-						for (int i = 0; i < corr1d.size(); i++) {
-							local_d += weights[cloud] * cost(projHist1[thread_num][i], projHist2[corr1d[i]]);
-						}
 
-						#pragma omp critical
-						{
-							for (int i = 0; i < cloud1Idx[thread_num].size(); i++) {
-								int perm = cloud1Idx[thread_num][i].second;
-								for (int j = 0; j < DIM; j++) {
-									newbary[perm][j] += DIM * (weights[cloud] * (projHist2[corr1d[i]] - projHist1[thread_num][i]) * dir[j]) / nslices;
-								}
-							}
-						}
+		for (int i = 0; i < omp_get_max_threads(); i++) {
+			free_simd(projHist2[i]);
+		}
+		return trace;
+	}
+
+	/// @brief Adds the displacements of K slices of a barycenter iteration to offset, by blocks of samples.
+	/// @details Called by all the threads of a parallel region, after the slices : each thread sums the displacements of
+	/// its blocks of samples, in the order of the slices, for each coordinate. The result does not depend on which thread
+	/// solved which slice.
+	/// @param displacements The displacement of each sample along the direction of each slice, times its cloud's weight.
+	/// @param dirs The directions of the K slices.
+	/// @param nslices The number of slices of the iteration : the displacements are averaged over them.
+	template<int DIM, typename T>
+	static void add_displacements(PointCloud<DIM, T> &offset, const std::vector<std::vector<T> > &displacements, const Point<DIM, T>* dirs, int K, int nslices) {
+		const int n = static_cast<int>(offset.size());
+		const int blocks = (n + barycenter_block - 1) / barycenter_block;
+	#pragma omp for schedule(static)
+		for (int block = 0; block < blocks; block++) {
+			const int first = block * barycenter_block;
+			const int size = std::min(barycenter_block, n - first);
+			for (int j = 0; j < DIM; j++) {
+				T* x = offset.coord(j) + first;
+				for (int k = 0; k < K; k++) {
+					const T* displacement = displacements[k].data() + first;
+					const T dir = dirs[k][j];
+					for (int i = 0; i < size; i++) {
+						x[i] += DIM * (displacement[i] * dir) / nslices;
 					}
-					free_simd(projHist2);
+				}
+			}
+		}
+	}
 
-					#pragma omp atomic
-					d += local_d;
+	/// @brief Moves each sample of points by step times the matching sample of offset.
+	/// @details The squared lengths are summed by blocks of barycenter_block samples, and the blocks in order : the sum
+	/// does not depend on the number of threads.
+	/// @return The sum of the squared lengths of the moves.
+	template<int DIM, typename T>
+	static double move_samples(std::vector<Point<DIM, T> > &points, const PointCloud<DIM, T> &offset, T step) {
+		const int n = static_cast<int>(points.size());
+		const int blocks = (n + barycenter_block - 1) / barycenter_block;
+		std::vector<double> block_moves(blocks, 0.);
+	#pragma omp parallel for schedule(static) if(n >= parallel_front_end_size)
+		for (int block = 0; block < blocks; block++) {
+			const int first = block * barycenter_block;
+			const int last = std::min(n, first + barycenter_block);
+			double moved = 0;
+			for (int i = first; i < last; i++) {
+				for (int j = 0; j < DIM; j++) {
+					const T move = step * offset.coord(j)[i];
+					points[i][j] += move;
+					moved += move * move;
 				}
 			}
-			barycenter = newbary;
+			block_moves[block] = moved;
+		}
+		double moved = 0;
+		for (int block = 0; block < blocks; block++) {
+			moved += block_moves[block];
+		}
+		return moved;
+	}
+
+	/// @brief Ends an iteration of the barycenters : moves the barycenter by offset, with the step of the iteration, and
+	/// records it in trace.
+	/// @param slice_costs The cost between the barycenter and the clouds on each slice, before it moves.
+	/// @return Whether the barycenter has converged, within barycenter_tolerance.
+	template<int DIM, typename T>
+	bool barycenter_iteration(BarycenterTrace &trace, const std::vector<double> &slice_costs, std::vector<Point<DIM, T> > &barycenter, const PointCloud<DIM, T> &offset) const {
+		double cost = 0;
+		for (int slice = 0; slice < slice_costs.size(); slice++) {
+			cost += slice_costs[slice];
+		}
+		cost /= std::max<std::size_t>(1, slice_costs.size());
+
+		double step = trace.steps.empty() ? 1. : trace.steps.back();
+		if (this->barycenter_adaptive_step && !trace.costs.empty()) {
+			// The cost is that of the previous move : it overshot if the cost increased.
+			step = cost > trace.costs.back() ? 0.5 * step : std::min(1., 1.5 * step);
+		}
+		const double displacement = std::sqrt(move_samples(barycenter, offset, static_cast<T>(step)) / std::max<std::size_t>(1, barycenter.size()));
+
+		trace.iterations++;
+		trace.costs.push_back(cost);
+		trace.displacements.push_back(displacement);
+		trace.steps.push_back(step);
+		if (this->barycenter_tolerance <= 0 || trace.iterations < 2) {
+			return false;
+		}
+		const double previous_cost = trace.costs[trace.iterations - 2];
+		trace.converged = std::abs(cost - previous_cost) <= this->barycenter_tolerance * previous_cost
+			&& displacement <= this->barycenter_tolerance * trace.displacements.front();
+		return trace.converged;
+	}
+
+	/// @brief unbalanced_barycenter() for weighted diracs : each sample of each cloud carries a mass.
+	/// @details The barycenter starts from the first Mbary samples of points[0] and their masses, which it keeps. Its
+	/// samples are moved towards the barycentric projection of their mass on each slice (see weighted_correspondencesNd()).
+	/// @param masses The mass of each sample of each cloud. The total of each cloud must not be less than the barycenter's.
+	/// @param barycenter_masses The mass of each sample of the barycenter.
+	/// @see unbalanced_barycenter()
+	template<int DIM, typename T, typename Cost = SquaredCost>
+	BarycenterTrace weighted_unbalanced_barycenter(int Mbary, int niters, int nslices, const std::vector<T> &weights, const std::vector< std::vector<Point<DIM, T> > > &points,
+										const std::vector< std::vector<T> > &masses, std::vector<Point<DIM, T> > &barycenter, std::vector<T> &barycenter_masses) {
+		const ThreadCountScope threads(this->num_threads);
+		barycenter.assign(points[0].begin(), points[0].begin() + Mbary);
+		barycenter_masses.assign(masses[0].begin(), masses[0].begin() + Mbary);
+
+		// The same directions as unbalanced_barycenter() :
+		srand(10);
+		engine.seed(10);
+		std::vector<Point<DIM, T> > dirs(nslices);
+		DirectionGenerator<DIM, T> directions(this->direction_sampling, nslices);
+		for (int slice = 0; slice < nslices; slice++) {
+			if (DIM == 2 && this->direction_sampling == DirectionSampling::gaussian) {
+				double theta = slice * M_PI / nslices;
+				dirs[slice][0] = cos(theta);
+				dirs[slice][1] = sin(theta);
+			} else {
+				dirs[slice] = directions.next();
+			}
 		}
 
+		int max_cloud_size = 0;
+		for (int cloud = 0; cloud < points.size(); cloud++) {
+			max_cloud_size = std::max(max_cloud_size, static_cast<int>(points[cloud].size()));
+		}
+		// The buffers of each thread, sized for the barycenter and the largest cloud :
+		std::vector<std::vector<T> > projections(omp_get_max_threads(), std::vector<T>(max_cloud_size));
+		std::vector<std::vector<T> > projHist2(omp_get_max_threads(), std::vector<T>(max_cloud_size));
+		std::vector<std::vector<T> > sortedMass2(omp_get_max_threads(), std::vector<T>(max_cloud_size));
+		std::vector<std::vector<T> > targets(omp_get_max_threads());
+		std::vector<std::vector<int> > order2(omp_get_max_threads(), std::vector<int>(max_cloud_size));
+		std::vector<RadixSortWorkspace<T> > sort_workspaces(omp_get_max_threads());
+		std::vector<std::vector<TransportPlanEntry<T> > > plans(omp_get_max_threads());
+		std::vector<WeightedTransportWorkspace<T> > workspaces(omp_get_max_threads());
+		WarmSortCache barycenter_orders;
+		barycenter_orders.reserve(nslices);
+		const int group = static_cast<int>(std::max<std::size_t>(1, std::min<std::size_t>(nslices, batch_projection_max_bytes / (std::max(Mbary, 1) * sizeof(T)))));
+		std::vector<std::vector<T> > barycenter_projections(group, std::vector<T>(Mbary));
+		std::vector<T*> barycenter_projections_ptr(group);
+		// The barycenter's projections, their permutation and its masses in that order, sorted once on each slice :
+		std::vector<std::vector<T> > projHist1(group, std::vector<T>(Mbary));
+		std::vector<std::vector<int> > order1(group, std::vector<int>(Mbary));
+		std::vector<std::vector<T> > sortedMass1(group, std::vector<T>(Mbary));
+		for (int g = 0; g < group; g++) {
+			barycenter_projections_ptr[g] = barycenter_projections[g].data();
+		}
 
-		for (int i = 0; i < omp_get_max_threads(); i++) {
-			free_simd(projHist1[i]);
+		std::vector<std::vector<T> > displacements(group, std::vector<T>(Mbary));
+		PointCloud<DIM, T> offset(Mbary);
+		std::vector<double> slice_costs(nslices);
+		BarycenterTrace trace;
+
+		for (int iter = 0; iter < niters; iter++) {
+			offset.set_zero();
+			std::fill(slice_costs.begin(), slice_costs.end(), 0.);
+			for (int first = 0; first < nslices; first += group) {
+				const int last = std::min(nslices, first + group);
+				BatchProjector<DIM, T>(&dirs[first], last - first).project(barycenter.data(), Mbary, barycenter_projections_ptr.data());
+				#pragma omp parallel for schedule(dynamic)
+				for (int slice = first; slice < last; slice++) {
+					const int thread_num = omp_get_thread_num();
+					const int g = slice - first;
+					warm_sort_projections(barycenter_projections_ptr[g], Mbary, projHist1[g].data(), order1[g].data(), sort_workspaces[thread_num], barycenter_orders, slice);
+					for (int i = 0; i < Mbary; i++) {
+						sortedMass1[g][i] = barycenter_masses[order1[g][i]];
+					}
+				}
+				for (int cloud = 0; cloud < points.size(); cloud++) {
+					const int N = static_cast<int>(points[cloud].size());
+					#pragma omp parallel
+					{
+						const int thread_num = omp_get_thread_num();
+						T* proj_values = projections[thread_num].data();
+						T* hist2 = projHist2[thread_num].data();
+						T* masses2 = sortedMass2[thread_num].data();
+						int* sorted_order2 = order2[thread_num].data();
+						std::vector<TransportPlanEntry<T> >& plan = plans[thread_num];
+
+						#pragma omp for schedule(dynamic)
+						for (int slice = first; slice < last; slice++) {
+							Point<DIM, T> dir = dirs[slice];
+							const T* hist1 = projHist1[slice - first].data();
+							const T* masses1 = sortedMass1[slice - first].data();
+							const int* sorted_order1 = order1[slice - first].data();
+
+							Projector<DIM, T> proj(dir);
+							for (int i = 0; i < N; i++) {
+								proj_values[i] = proj.proj(points[cloud][i]);
+							}
+							radix_sort_projections(proj_values, N, hist2, sorted_order2, sort_workspaces[thread_num]);
+							for (int i = 0; i < N; i++) {
+								masses2[i] = masses[cloud][sorted_order2[i]];
+							}
+
+							slice_costs[slice] += weights[cloud] * weighted_transport1d<T, Cost>(hist1, masses1, Mbary, hist2, masses2, N, plan, workspaces[thread_num]);
+							barycentric_projection(plan, hist1, hist2, Mbary, targets[thread_num]);
+
+							T* displacement = displacements[slice - first].data();
+							for (int i = 0; i < Mbary; i++) {
+								displacement[sorted_order1[i]] = weights[cloud] * (targets[thread_num][i] - hist1[i]);
+							}
+						}
+
+						add_displacements(offset, displacements, &dirs[first], last - first, nslices);
+					}
+				}
+			}
+			if (this->barycenter_iteration(trace, slice_costs, barycenter, offset)) {
+				break;
+			}
 		}
+		return trace;
 	}
 
 	/// @brief Simple typedef to the CImg library type in order to simplify declarations later.
@@ -954,7 +3243,8 @@ public:
 	/// @brief Computes FIST : a Transport-based ICP, using either a rigid transform or similarity transform.
 	/// @tparam DIM The dimensionality of the datasets to register.
 	/// @tparam T The internal data type of the samples from both datasets.
-	/// @param niters The number of iteration to perform (MAXIMUM ??? OR ALWAYS PERFORMS THEM ???)
+	/// @param niters The maximum number of iterations to perform : fewer once the FIST tolerances are met (see
+	/// fist_rotation_tolerance). The number performed is kept in fist_iterations.
 	/// @param nslices The number of 1D-slices to perform when computing the correspondances at each iteration.
 	/// @param pointsSrc The original point cloud, the one to register ('X' in the paper).
 	/// @param pointsDst The target point cloud, the one to register against ('Y' in the paper).
@@ -962,8 +3252,12 @@ public:
 	/// @param transformation_translation The translation vector extracted from the FIST algorithm.
 	/// @param useScaling If true, will extract a similarity transform (isotropic scaling). Otherwise, will extract a rigid transform.
 	/// @param scaling The scaling factor extracted from this algorithm, if useScaling was set to true.
-	/// @param time_logger If a non-null pointer is passed, will record the iteration times for this run of the FIST algorithm.
-	template<int DIM, typename T>
+	/// @param time_logger If a non-null pointer is passed, will record the iteration times for this run of the FIST algorithm,
+	/// and the statistics of its 1D transports (see micro_benchmarks::TransportStats).
+	/// @param target_projections If non-null, the sorted projections of pointsDst on the slices, to share with the other
+	/// registrations against it. Otherwise, they are cached for the iterations of this registration only.
+	/// @tparam Cost The ground cost policy of the 1D transports (see cost_policies.h).
+	template<int DIM, typename T, typename Cost = SquaredCost>
 	std::unique_ptr<micro_benchmarks::TimingsLogger> fast_iterative_sliced_transport(
 			int niters,
 			int nslices,
@@ -974,7 +3268,55 @@ public:
 			bool useScaling,
 			double &scaling,
 			std::unique_ptr<micro_benchmarks::TimingsLogger> time_logger = nullptr,
-			const std::function<void(UnbalancedSliced*)>& per_iteration_callback = [](UnbalancedSliced* ub) -> void {return;}
+			const std::function<void(UnbalancedSliced*)>& per_iteration_callback = [](UnbalancedSliced* ub) -> void {return;},
+			SortedProjectionCache<T>* target_projections = nullptr
+	) {
+		const ThreadCountScope threads(this->num_threads);
+		// The source is moved around at each iteration : store it by coordinate. pointsDst is kept as is, as it identifies
+		// the cached projections.
+		PointCloud<DIM, T> source(pointsSrc);
+		time_logger = iterative_sliced_transport<DIM, T, Cost>(niters, nslices, source, pointsDst, transformation_rotation, transformation_translation,
+																useScaling, scaling, std::move(time_logger), target_projections);
+		source.copy_to(pointsSrc);
+		return time_logger;
+	}
+
+	/// @brief fast_iterative_sliced_transport() on point clouds stored by coordinate, which avoids converting them.
+	/// @details pointsDst must not be re-allocated between registrations sharing target_projections.
+	template<int DIM, typename T, typename Cost = SquaredCost>
+	std::unique_ptr<micro_benchmarks::TimingsLogger> fast_iterative_sliced_transport(
+			int niters,
+			int nslices,
+			PointCloud<DIM, T> &pointsSrc,
+			const PointCloud<DIM, T> &pointsDst,
+			std::vector<double> &transformation_rotation,
+			std::vector<double> &transformation_translation,
+			bool useScaling,
+			double &scaling,
+			std::unique_ptr<micro_benchmarks::TimingsLogger> time_logger = nullptr,
+			SortedProjectionCache<T>* target_projections = nullptr
+	) {
+		const ThreadCountScope threads(this->num_threads);
+		return iterative_sliced_transport<DIM, T, Cost>(niters, nslices, pointsSrc, pointsDst, transformation_rotation, transformation_translation,
+														useScaling, scaling, std::move(time_logger), target_projections);
+	}
+
+	/// @brief Number of samples centered at once by the iterations of fast_iterative_sliced_transport().
+	static constexpr int fist_block = 256;
+
+	/// @brief The iterations of fast_iterative_sliced_transport(), on a target stored either as a vector of points or as a PointCloud.
+	template<int DIM, typename T, typename Cost, typename Cloud>
+	std::unique_ptr<micro_benchmarks::TimingsLogger> iterative_sliced_transport(
+			int niters,
+			int nslices,
+			PointCloud<DIM, T> &pointsSrc,
+			const Cloud &pointsDst,
+			std::vector<double> &transformation_rotation,
+			std::vector<double> &transformation_translation,
+			bool useScaling,
+			double &scaling,
+			std::unique_ptr<micro_benchmarks::TimingsLogger> time_logger,
+			SortedProjectionCache<T>* target_projections
 	) {
 		using default_image_t = image_t<double>;
 
@@ -986,31 +3328,73 @@ public:
 			transformation_rotation[i * DIM + i] = 1;
 		std::fill(transformation_translation.begin(), transformation_translation.end(), 0);
 
+		TransportWorkspace<T> workspace(pointsSrc.size(), pointsDst.size());
+		// pointsDst does not move, and correspondencesNd() draws the same slices at each iteration :
+		SortedProjectionCache<T> local_target_projections;
+		workspace.target_projections = target_projections ? target_projections : &local_target_projections;
+
+		const int n = static_cast<int>(pointsSrc.size());
+		// The advection of each iteration moves the source by this displacement, rather than a copy of the source :
+		PointCloud<DIM, T> displacement(n);
+		DisplacedCloud<DIM, T> advected{pointsSrc, displacement};
+		this->fist_iterations = 0;
 		for (int iter = 0; iter < niters; iter++) {
 			if (time_logger) { time_logger->start_lap(); }
 
 			/* Compute the correspondances between the two points at this stage : */
-			std::vector<Point<DIM, T> > pointsSrcCopy(pointsSrc);
-			correspondencesNd(pointsSrcCopy, pointsDst, nslices, true);
+			displacement.set_zero();
+			sliced_correspondences<DIM, T, Cost>(advected, pointsDst, nslices, true, &workspace, nullptr);
 
-			/* Compute the centers of both the source, and the 'registered' source */
 			Point<DIM, T> center1, center2;
-			for (int i = 0; i < pointsSrc.size(); i++) {
-				center1 += pointsSrc[i];
-				center2 += pointsSrcCopy[i];  // pointsSrcCopy and pointsSrc have the same size
-			}
-			center1 *= (1.0 / pointsSrc.size());
-			center2 *= (1.0 / pointsSrc.size());
-
-			/* Compute the covariance matrix : */
 			double cov[DIM*DIM]; ///< The covariance matrix of both distributions after centering
-			memset(cov, 0, DIM*DIM * sizeof(cov[0]));
-			for (int i = 0; i < pointsSrc.size(); i++) {
-				Point<DIM, T> p = pointsSrc[i] - center1;
-				Point<DIM, T> q = pointsSrcCopy[i] - center2;
+			double variance = 0;
+			if (this->fist_fused_moments) {
+				fist_moments(pointsSrc, displacement, center1, center2, cov, variance);
+			} else {
+				/* Compute the centers of both the source, and the 'registered' source */
 				for (int j = 0; j < DIM; j++) {
-					for (int k = 0; k < DIM; k++) {
-						cov[j * DIM + k] += q[j] * p[k];
+					const T* x1 = pointsSrc.coord(j);
+					const T* d1 = displacement.coord(j);
+					double sum1 = 0, sum2 = 0;
+				#pragma omp simd reduction(+:sum1, sum2)
+					for (int i = 0; i < n; i++) {
+						sum1 += x1[i];
+						sum2 += static_cast<T>(x1[i] + d1[i]);
+					}
+					center1[j] = static_cast<T>(sum1 / n);
+					center2[j] = static_cast<T>(sum2 / n);
+				}
+
+				/* Compute the covariance matrix, and the variance of the source for the scaling, by blocks of centered samples : */
+				memset(cov, 0, DIM*DIM * sizeof(cov[0]));
+				for (int first = 0; first < n; first += fist_block) {
+					const int size = std::min(fist_block, n - first);
+					T p[DIM][fist_block], q[DIM][fist_block];
+					for (int j = 0; j < DIM; j++) {
+						const T* x1 = pointsSrc.coord(j) + first;
+						const T* d1 = displacement.coord(j) + first;
+						for (int i = 0; i < size; i++) {
+							p[j][i] = x1[i] - center1[j];
+							q[j][i] = static_cast<T>(x1[i] + d1[i]) - center2[j];
+						}
+					}
+					for (int j = 0; j < DIM; j++) {
+						for (int k = 0; k < DIM; k++) {
+							double s = 0;
+						#pragma omp simd reduction(+:s)
+							for (int i = 0; i < size; i++) {
+								s += q[j][i] * p[k][i];
+							}
+							cov[j * DIM + k] += s;
+						}
+						if (useScaling) {
+							double s = 0;
+						#pragma omp simd reduction(+:s)
+							for (int i = 0; i < size; i++) {
+								s += p[j][i] * p[j][i];
+							}
+							variance += s;
+						}
 					}
 				}
 			}
@@ -1032,15 +3416,11 @@ public:
 
 			double scal = 1;
 			if (useScaling) {
-				double std = 0;
-				for (int i = 0; i < pointsSrc.size(); i++) {
-					std += (pointsSrc[i]-center1).norm2();
-				}
 				double s2 = 0;
 				for (int i = 0; i < DIM; i++) {
 					s2 += std::abs(S(0,i));
 				}
-				scal = s2 / std;
+				scal = s2 / variance;
 				scaling *= scal;
 			}
 
@@ -1052,14 +3432,34 @@ public:
 			default_image_t C2(&center2[0], 1, DIM);
 			rotG = rotM*rotG;
 			transG = transG + C2 - C1;
+			const bool converged = this->fist_converged<DIM, T>(rotM.data(), scal, center1, center2);
 
-			// Apply the computed transformation
-			for (int i = 0; i < pointsSrc.size(); i++) {
-				image_t<T> P(const_cast<T*>(&pointsSrc[i][0]), 1,DIM,1,1,true);
-				P = scal*(rotM * (P - C1)) + C2;
+			// Apply the computed transformation, P = scal*(rotM * (P - C1)) + C2, with the rounding of the CImg products :
+			T* x[DIM];
+			for (int j = 0; j < DIM; j++) {
+				x[j] = pointsSrc.coord(j);
+			}
+			const double* R = rotM.data();
+		#pragma omp parallel for schedule(static) if(n >= parallel_front_end_size)
+			for (int i = 0; i < n; i++) {
+				double centered[DIM];
+				for (int k = 0; k < DIM; k++) {
+					centered[k] = static_cast<double>(x[k][i]) - C1[k];
+				}
+				for (int j = 0; j < DIM; j++) {
+					double y = 0;
+					for (int k = 0; k < DIM; k++) {
+						y += R[j * DIM + k] * centered[k];
+					}
+					x[j][i] = static_cast<T>(scal * y + C2[j]);
+				}
 			}
 
 			if (time_logger) { time_logger->stop_lap(); }
+			this->fist_iterations++;
+			if (converged) {
+				break;
+			}
 		}
 
 		default_image_t rotG(const_cast<double*>(&transformation_rotation[0]), DIM, DIM, 1, 1, true);
@@ -1070,11 +3470,122 @@ public:
 			transG = rotG * transG;
 
 		if (time_logger) {
+			time_logger->drop_unused_laps();
 			time_logger->compute_timing_stats();
+			time_logger->get_transport_stats().merge(workspace.stats);
 		}
 
 		return time_logger;
 	}
 
+	/// @brief Computes, in a single pass over the samples, the centers of source and of advected (source plus
+	/// displacement), the covariance of advected and source, and the variance of source times its size, as used by an
+	/// iteration of FIST.
+	/// @details The samples are summed by blocks in parallel, around the first sample of each cloud rather than around
+	/// their centers : the covariance and variance are then corrected by the centers, which loses accuracy for clouds
+	/// much further from their first sample than their spread. The blocks are summed in order : the result does not
+	/// depend on the number of threads.
+	/// @param cov Receives the DIM x DIM covariance, by rows of advected coordinates.
+	template<int DIM, typename T>
+	static void fist_moments(const PointCloud<DIM, T> &source, const PointCloud<DIM, T> &displacement, Point<DIM, T> &center1, Point<DIM, T> &center2,
+							 double* cov, double &variance) {
+		// The sums of each block : the coordinates of source and advected, their products, and the squared norm of source.
+		constexpr int nsums = 2 * DIM + DIM * DIM + 1;
+		const int n = static_cast<int>(source.size());
+		const int blocks = (n + fist_block - 1) / fist_block;
+		T reference1[DIM], reference2[DIM];
+		for (int j = 0; j < DIM; j++) {
+			reference1[j] = n > 0 ? source.coord(j)[0] : T(0);
+			reference2[j] = n > 0 ? static_cast<T>(source.coord(j)[0] + displacement.coord(j)[0]) : T(0);
+		}
+		std::vector<double> sums(static_cast<std::size_t>(blocks) * nsums);
+	#pragma omp parallel for schedule(static) if(n >= parallel_front_end_size)
+		for (int block = 0; block < blocks; block++) {
+			const int first = block * fist_block;
+			const int size = std::min(fist_block, n - first);
+			double* block_sums = &sums[static_cast<std::size_t>(block) * nsums];
+			T p[DIM][fist_block], q[DIM][fist_block];
+			for (int j = 0; j < DIM; j++) {
+				const T* x1 = source.coord(j) + first;
+				const T* d1 = displacement.coord(j) + first;
+				double s1 = 0, s2 = 0;
+			#pragma omp simd reduction(+:s1, s2)
+				for (int i = 0; i < size; i++) {
+					p[j][i] = x1[i] - reference1[j];
+					q[j][i] = static_cast<T>(x1[i] + d1[i]) - reference2[j];
+					s1 += p[j][i];
+					s2 += q[j][i];
+				}
+				block_sums[j] = s1;
+				block_sums[DIM + j] = s2;
+			}
+			double squares = 0;
+			for (int j = 0; j < DIM; j++) {
+				for (int k = 0; k < DIM; k++) {
+					double s = 0;
+				#pragma omp simd reduction(+:s)
+					for (int i = 0; i < size; i++) {
+						s += q[j][i] * p[k][i];
+					}
+					block_sums[2 * DIM + j * DIM + k] = s;
+				}
+				double s = 0;
+			#pragma omp simd reduction(+:s)
+				for (int i = 0; i < size; i++) {
+					s += p[j][i] * p[j][i];
+				}
+				squares += s;
+			}
+			block_sums[nsums - 1] = squares;
+		}
+
+		double total[nsums] = {};
+		for (int block = 0; block < blocks; block++) {
+			for (int k = 0; k < nsums; k++) {
+				total[k] += sums[static_cast<std::size_t>(block) * nsums + k];
+			}
+		}
+		double mean1[DIM], mean2[DIM];
+		variance = total[nsums - 1];
+		for (int j = 0; j < DIM; j++) {
+			mean1[j] = total[j] / n;
+			mean2[j] = total[DIM + j] / n;
+			center1[j] = static_cast<T>(reference1[j] + mean1[j]);
+			center2[j] = static_cast<T>(reference2[j] + mean2[j]);
+			variance -= n * mean1[j] * mean1[j];
+		}
+		for (int j = 0; j < DIM; j++) {
+			for (int k = 0; k < DIM; k++) {
+				cov[j * DIM + k] = total[2 * DIM + j * DIM + k] - n * mean2[j] * mean1[k];
+			}
+		}
+	}
+
+	/// @brief Returns whether an iteration of FIST, which rotates the source by rotation and scales it by scal around its
+	/// center, and moves that center from center1 to center2, is within the FIST tolerances (see fist_rotation_tolerance).
+	template<int DIM, typename T>
+	bool fist_converged(const double* rotation, double scal, const Point<DIM, T> &center1, const Point<DIM, T> &center2) const {
+		if (this->fist_rotation_tolerance <= 0 && this->fist_translation_tolerance <= 0 && this->fist_scaling_tolerance <= 0) {
+			return false;
+		}
+		// The rotation of angle a in a plane is at a Frobenius distance of 2 sqrt(2) sin(a / 2) from the identity :
+		double distance = 0;
+		for (int i = 0; i < DIM; i++) {
+			for (int j = 0; j < DIM; j++) {
+				const double r = rotation[i * DIM + j] - (i == j ? 1. : 0.);
+				distance += r * r;
+			}
+		}
+		const double angle = 2 * std::asin(std::min(1., std::sqrt(distance / 8)));
+		double shift = 0;
+		for (int j = 0; j < DIM; j++) {
+			shift += (static_cast<double>(center2[j]) - center1[j]) * (static_cast<double>(center2[j]) - center1[j]);
+		}
+		shift = std::sqrt(shift);
+		return (this->fist_rotation_tolerance <= 0 || angle <= this->fist_rotation_tolerance)
+			&& (this->fist_translation_tolerance <= 0 || shift <= this->fist_translation_tolerance)
+			&& (this->fist_scaling_tolerance <= 0 || std::abs(scal - 1) <= this->fist_scaling_tolerance);
+	}
+
 
 };
@@ -0,0 +1,109 @@
+#pragma once
+/*
+  Copyright (c) 2019 CNRS
+  Nicolas Bonneel <nicolas.bonneel@liris.cnrs.fr>
+  David Coeurjolly <david.coeurjolly@liris.cnrs.fr>
+
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIEDi
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Ground costs of the 1D solver. The solver is templated on one of the policies below, so that the cost is inlined in
+// its inner loops. A policy provides :
+//   - static T cost(T x, T y) : the cost of matching x to y,
+//   - static T sum_costs(const T* h1, int start1, const T* h2, int start2, int n) : the cost of matching the n values
+//     of h1 from start1 to the n values of h2 from start2, h1 being aligned as by malloc_simd().
+// The solver requires the cost to be a non-decreasing function of |x - y| (see nearest_neighbor_match()).
+
+#include <cmath>
+
+// Runtime-dispatched SIMD kernels of the squared Euclidean cost, in UnbalancedSliced.cpp.
+double sumCosts(const double* h1, int start1, const double* h2, int start2, int n);
+float sumCosts(const float* h1, int start1, const float* h2, int start2, int n);
+
+/// @brief The squared Euclidean cost (x - y)^2. The default cost of the solver.
+struct SquaredCost {
+	template<typename T>
+	static inline T cost(T x, T y) {
+		const T z = x - y;
+		return z*z;
+	}
+
+	/// @brief Short sums are inlined, longer ones use the widest SIMD kernel the CPU supports (see sse_helpers.h).
+	template<typename T>
+	static inline T sum_costs(const T* h1, int start1, const T* h2, int start2, int n) {
+		if (n >= 32) {
+			return sumCosts(h1, start1, h2, start2, n);
+		}
+		T s = 0;
+		for (int i = 0; i < n; i++) {
+			s += cost(h1[start1 + i], h2[start2 + i]);
+		}
+		return s;
+	}
+};
+
+/// @brief The cost |x - y|^P, for an integer P >= 1.
+/// @details Sums are accumulated over 4 independent lanes, which the compiler can map to vector registers.
+template<int P>
+struct PowerCost {
+	static_assert(P >= 1, "PowerCost needs a positive exponent.");
+
+	template<typename T>
+	static inline T cost(T x, T y) {
+		const T z = std::abs(x - y);
+		T r = z;
+		for (int i = 1; i < P; i++) {
+			r *= z;
+		}
+		return r;
+	}
+
+	template<typename T>
+	static inline T sum_costs(const T* h1, int start1, const T* h2, int start2, int n) {
+		const T* h1p = h1 + start1;
+		const T* h2p = h2 + start2;
+		T s[4] = {0, 0, 0, 0};
+		int i = 0;
+		for (; i + 4 <= n; i += 4) {
+			for (int k = 0; k < 4; k++) {
+				s[k] += cost(h1p[i + k], h2p[i + k]);
+			}
+		}
+		for (; i < n; i++) {
+			s[0] += cost(h1p[i], h2p[i]);
+		}
+		return (s[0] + s[1]) + (s[2] + s[3]);
+	}
+};
+
+/// @brief The absolute cost |x - y|. Less sensitive to outliers than the squared cost.
+using L1Cost = PowerCost<1>;
+
+// Quadratic cost in 1-d, kept for the code outside of the solver.
+inline double cost(double x, double y) {
+	return SquaredCost::cost(x, y);
+}
+inline float cost(float x, float y) {
+	return SquaredCost::cost(x, y);
+}
@@ -23,6 +23,99 @@ namespace micro_benchmarks {
 		total_running_time(no_time_coarse)
 	{}
 
+	TransportStats::TransportStats() {
+		this->reset();
+	}
+
+	void TransportStats::reset() {
+		this->slices = 0;
+		this->slices_balanced = 0;
+		this->slices_solved_by_reduce_range = 0;
+		this->slices_not_split = 0;
+		this->size_one_splits = 0;
+		this->subproblems = 0;
+		this->solved_equal_sizes = 0;
+		this->solved_one_free_target = 0;
+		this->solved_single_source = 0;
+		this->solved_injective_nearest_neighbors = 0;
+		this->solved_by_reduce_range = 0;
+		this->solved_by_simple_solve = 0;
+		this->solved_approximately = 0;
+		std::fill(std::begin(this->subproblem_sizes), std::end(this->subproblem_sizes), 0);
+		this->largest_simple_solve_M = 0;
+		this->largest_simple_solve_N = 0;
+		this->nearest_neighbor_time = no_time;
+		this->reduce_range_time = no_time;
+		this->decomposition_time = no_time;
+		this->subproblems_time = no_time;
+	}
+
+	void TransportStats::merge(const TransportStats &other) {
+		this->slices += other.slices;
+		this->slices_balanced += other.slices_balanced;
+		this->slices_solved_by_reduce_range += other.slices_solved_by_reduce_range;
+		this->slices_not_split += other.slices_not_split;
+		this->size_one_splits += other.size_one_splits;
+		this->subproblems += other.subproblems;
+		this->solved_equal_sizes += other.solved_equal_sizes;
+		this->solved_one_free_target += other.solved_one_free_target;
+		this->solved_single_source += other.solved_single_source;
+		this->solved_injective_nearest_neighbors += other.solved_injective_nearest_neighbors;
+		this->solved_by_reduce_range += other.solved_by_reduce_range;
+		this->solved_by_simple_solve += other.solved_by_simple_solve;
+		this->solved_approximately += other.solved_approximately;
+		for (int k = 0; k < size_buckets; ++k) {
+			this->subproblem_sizes[k] += other.subproblem_sizes[k];
+		}
+		if (other.largest_simple_solve_M > this->largest_simple_solve_M) {
+			this->largest_simple_solve_M = other.largest_simple_solve_M;
+			this->largest_simple_solve_N = other.largest_simple_solve_N;
+		}
+		this->nearest_neighbor_time += other.nearest_neighbor_time;
+		this->reduce_range_time += other.reduce_range_time;
+		this->decomposition_time += other.decomposition_time;
+		this->subproblems_time += other.subproblems_time;
+	}
+
+	void TransportStats::add_subproblem_size(int M) {
+		int bucket = 0;
+		while (bucket < size_buckets - 1 && (M >> (bucket + 1)) > 0) {
+			bucket++;
+		}
+		this->subproblem_sizes[bucket]++;
+	}
+
+	void TransportStats::print(const std::string &prefix) const {
+		if (not transport_stats_enabled) {
+			std::cout << prefix << "<1D solver statistics disabled, build with SPOT_ENABLE_TRANSPORT_STATS>\n";
+			return;
+		}
+		std::cout << prefix << fmt::format("1D solver statistics over {} slices :\n", this->slices);
+		std::cout << prefix << fmt::format("- Balanced                 : {: >12}\n", this->slices_balanced);
+		std::cout << prefix << fmt::format("- Solved by reduce_range() : {: >12}\n", this->slices_solved_by_reduce_range);
+		std::cout << prefix << fmt::format("- Not split                : {: >12}\n", this->slices_not_split);
+		std::cout << prefix << fmt::format("- Size-1 splits            : {: >12}\n", this->size_one_splits);
+		std::cout << prefix << fmt::format("- Sub-problems             : {: >12}\n", this->subproblems);
+		std::cout << prefix << fmt::format("  - M == N                 : {: >12}\n", this->solved_equal_sizes);
+		std::cout << prefix << fmt::format("  - M == N - 1             : {: >12}\n", this->solved_one_free_target);
+		std::cout << prefix << fmt::format("  - M == 1                 : {: >12}\n", this->solved_single_source);
+		std::cout << prefix << fmt::format("  - Injective NN           : {: >12}\n", this->solved_injective_nearest_neighbors);
+		std::cout << prefix << fmt::format("  - reduce_range()         : {: >12}\n", this->solved_by_reduce_range);
+		std::cout << prefix << fmt::format("  - simple_solve()         : {: >12}\n", this->solved_by_simple_solve);
+		std::cout << prefix << fmt::format("  - Approximated           : {: >12}\n", this->solved_approximately);
+		std::cout << prefix << fmt::format("- Largest simple_solve()   : {} x {}\n", this->largest_simple_solve_M, this->largest_simple_solve_N);
+		std::cout << prefix << "Sub-problem sizes :\n";
+		for (int k = 0; k < size_buckets; ++k) {
+			if (this->subproblem_sizes[k] == 0) continue;
+			std::cout << prefix << fmt::format("- [{}, {}) : {: >12}\n", 1ull << k, 1ull << (k + 1), this->subproblem_sizes[k]);
+		}
+		std::cout << prefix << "Time per phase :\n";
+		std::cout << prefix << fmt::format("- Nearest neighbors : {: >24.8}\n", to_coarse_t(this->nearest_neighbor_time));
+		std::cout << prefix << fmt::format("- reduce_range()    : {: >24.8}\n", to_coarse_t(this->reduce_range_time));
+		std::cout << prefix << fmt::format("- Decomposition     : {: >24.8}\n", to_coarse_t(this->decomposition_time));
+		std::cout << prefix << fmt::format("- Sub-problems      : {: >24.8}\n", to_coarse_t(this->subproblems_time));
+	}
+
 	// If nothing's given, preallocate 1000 spots.
 	TimingsLogger::TimingsLogger() : TimingsLogger(1000) {}
 
@@ -51,12 +144,21 @@ namespace micro_benchmarks {
 		this->last_lap++;
 	}
 
+	void TimingsLogger::drop_unused_laps() {
+		if (this->last_lap < this->iteration_times.size()) {
+			this->iteration_times.resize(this->last_lap);
+		}
+	}
+
 	void TimingsLogger::compute_timing_stats() {
 		if (not this->stats) {
 			this->stats = std::make_shared<TimeSeriesStatistics>();
 		}
 		auto nblaps = this->iteration_times.size();
 		std::cout << fmt::format("Computing statistics over {} laps ...", nblaps) << '\n';
+		if (nblaps == 0) {
+			return;
+		}
 
 		// Sort data :
 		std::vector<duration_t> sorted_data(this->iteration_times.cbegin(), this->iteration_times.cend());
@@ -80,7 +182,8 @@ namespace micro_benchmarks {
 
 		auto compute_percentile = [nblaps,&sorted_data](double percentage) -> duration_t {
 			auto ordinal = static_cast<unsigned int>(std::ceil(percentage/100.0*static_cast<double>(nblaps)));
-			return sorted_data[ordinal];
+			// Runs stopped early may have fewer than 100 laps :
+			return sorted_data[std::min<std::size_t>(ordinal, nblaps - 1)];
 		};
 		this->stats->quartile_1 = duration_t(compute_percentile(25.0));
 		this->stats->median = duration_t(compute_percentile(50.0));
@@ -129,6 +232,10 @@ namespace micro_benchmarks {
 			std::cout << prefix << "<no timings computed for this run yet>\n";
 		}
 
+		if (transport_stats_enabled) {
+			this->transport_stats.print(prefix);
+		}
+
 		if (not banner_message.empty()) {
 			std::cout << prefix << "--- " << banner_message << " ---" << '\n';
 		}
@@ -139,6 +246,7 @@ namespace micro_benchmarks {
 		this->last_start = my_clock_t::now();
 		this->last_lap = 0;
 		this->stats.reset();
+		this->transport_stats.reset();
 	}
 
 	LapTimer::LapTimer(std::shared_ptr<TimingsLogger> &timer, unsigned int lap_nb) :
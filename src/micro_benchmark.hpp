@@ -10,10 +10,18 @@
  */
 
 #include <chrono>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
+/// @brief Wraps the statements recording TransportStats, compiled out unless SPOT_ENABLE_TRANSPORT_STATS is defined.
+#ifdef SPOT_ENABLE_TRANSPORT_STATS
+	#define SPOT_TRANSPORT_STATS(...) __VA_ARGS__
+#else
+	#define SPOT_TRANSPORT_STATS(...)
+#endif
+
 /// @brief Some utility classes for time-related benchmarks.
 namespace micro_benchmarks {
 
@@ -41,6 +49,64 @@ namespace micro_benchmarks {
 		coarse_duration_t total_running_time;
 	};
 
+	/// @brief Whether the 1D solver fills in TransportStats (see the SPOT_ENABLE_TRANSPORT_STATS CMake option).
+#ifdef SPOT_ENABLE_TRANSPORT_STATS
+	constexpr bool transport_stats_enabled = true;
+#else
+	constexpr bool transport_stats_enabled = false;
+#endif
+
+	/// @brief Counters of the paths taken by the 1D solver (UnbalancedSliced::transport1d()), to find out why some slices are slow.
+	/// @details Only filled in when compiled with SPOT_ENABLE_TRANSPORT_STATS : otherwise, the solver does not record
+	/// anything and all counters stay at zero. The counters accumulate over all the slices solved until reset().
+	struct TransportStats {
+		/// @brief The number of buckets of the sub-problem size histogram : bucket k counts the sizes in [2^k, 2^(k+1)).
+		static constexpr int size_buckets = 32;
+
+		TransportStats();
+
+		/// @brief Sets all the counters and times back to zero.
+		void reset();
+
+		/// @brief Adds the counters and times of other to these ones.
+		void merge(const TransportStats &other);
+
+		/// @brief Counts a sub-problem of M source samples in the size histogram.
+		void add_subproblem_size(int M);
+
+		/// @brief Print the counters to the screen, each line starting with prefix.
+		void print(const std::string &prefix) const;
+
+		/// @brief Returns the time elapsed since start, and sets start to now.
+		static duration_t lap(timepoint_t &start) {
+			const timepoint_t now = my_clock_t::now();
+			const duration_t elapsed = now - start;
+			start = now;
+			return elapsed;
+		}
+
+		std::uint64_t slices; ///< The number of slices solved.
+		std::uint64_t slices_balanced; ///< The slices with as many source as target samples, matched in order.
+		std::uint64_t slices_solved_by_reduce_range; ///< The slices entirely matched by the front end's reduce_range().
+		std::uint64_t slices_not_split; ///< The slices linear_time_decomposition() did not split, solved as one sub-problem.
+		std::uint64_t size_one_splits; ///< The sub-problems of a single source sample, matched directly by the front end.
+		std::uint64_t subproblems; ///< The sub-problems left to the parallel part of the solver.
+		std::uint64_t solved_equal_sizes; ///< Sub-problems solved as M == N : samples matched in order.
+		std::uint64_t solved_one_free_target; ///< Sub-problems solved as M == N - 1 : one target sample left free.
+		std::uint64_t solved_single_source; ///< Sub-problems solved as M == 1 : a nearest neighbor in range.
+		std::uint64_t solved_injective_nearest_neighbors; ///< Sub-problems whose nearest-neighbor map is injective.
+		std::uint64_t solved_by_reduce_range; ///< Sub-problems entirely matched by reduce_range().
+		std::uint64_t solved_by_simple_solve; ///< Sub-problems left to simple_solve(), the general (quadratic) case.
+		std::uint64_t solved_approximately; ///< Sub-problems approximated instead, by approximate_transport1d().
+		std::uint64_t subproblem_sizes[size_buckets]; ///< Histogram of the number of source samples of the sub-problems.
+		int largest_simple_solve_M; ///< The number of source samples of the largest simple_solve() instance.
+		int largest_simple_solve_N; ///< The number of target samples of that same instance.
+		duration_t nearest_neighbor_time; ///< Time spent in the front end's nearest neighbor matches.
+		duration_t reduce_range_time; ///< Time spent in the front end's reduce_range().
+		duration_t decomposition_time; ///< Time spent in linear_time_decomposition().
+		duration_t subproblems_time; ///< Wall time of the parallel loops solving the sub-problems.
+	};
+
 	class TimingsLogger {
 
 	public: /* Constructors and destructors */
@@ -67,6 +133,9 @@ namespace micro_benchmarks {
 		/// @brief Stops the chrono for this lap.
 		void stop_lap();
 
+		/// @brief Drops the pre-allocated laps after the last one stopped, for a timed run which ended early.
+		void drop_unused_laps();
+
 		/// @brief Compute info about the timings.
 		void compute_timing_stats();
 
@@ -82,12 +151,19 @@ namespace micro_benchmarks {
 		/// @brief Gets a copy of the currently-computed statistics for all iteration times.
 		const TimeSeriesStatistics::Ptr& get_time_statistics() const { return this->stats; };
 
+		/// @brief Gets the counters of the 1D solver, recorded during the timed run (see TransportStats).
+		const TransportStats& get_transport_stats() const { return this->transport_stats; }
+
+		/// @brief Gets the counters of the 1D solver, for the timed code to add to.
+		TransportStats& get_transport_stats() { return this->transport_stats; }
+
 	protected:
 		std::vector<duration_t> iteration_times; ///< The iteration times, updated each time fast_iterative_sliced_optimal_transfer() is called.
 		unsigned int last_lap; ///< The last lap index (whenever using the {start|stop}_lap() functions)
 		timepoint_t last_start; ///< The last start time point of the {start|stop}_lap() functions
 
 		TimeSeriesStatistics::Ptr stats; ///< The computed statistics for this series of time periods.
+		TransportStats transport_stats; ///< The counters of the 1D solver during the timed run. Zero unless enabled at compile time.
 	};
 
 	/// @brief RAII-style lap timer.
@@ -11,6 +11,7 @@
 
 #include "../external/glm_bridge.hpp"
 #include "Point.h"
+#include "PointCloud.h"
 
 #include <string>
 #include <vector>
@@ -19,6 +20,8 @@
 struct Model {
 	Model();
 	Model(const std::vector<glm::vec3>& vertices, std::vector<glm::uvec3> triangles);
+	/// @brief Builds a model from positions stored by coordinate, such as the result of a registration.
+	Model(const PointCloud<3, float>& positions, std::vector<glm::uvec3> triangles);
 	Model(const Model& _other);
 	Model(Model&& _other) noexcept;
 	~Model() = default;
@@ -35,6 +38,11 @@ struct Model {
 	///   model to its original position.
 	void apply_scaling(double scaling, bool center_before_scaling);
 
+	/// @brief Returns a copy of the positions stored by coordinate, as taken by the registration methods.
+	PointCloud<3, float> position_cloud() const;
+	/// @brief Replaces the positions by the given ones, stored by coordinate. The triangles are kept.
+	void set_positions(const PointCloud<3, float>& cloud);
+
 	std::vector<Point<3, float>> positions;
 	std::vector<glm::uvec3> triangles;
 };
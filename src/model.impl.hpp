@@ -86,6 +86,9 @@ Model::Model(const std::vector<glm::vec3>& vertices, const std::vector<glm::uvec
 	positions(vertices.cbegin(), vertices.cend()), triangles(_triangles) {}
 	// Note : range-based ctor of vector is supposed to perform the conversions automatically if an explicit cast op exists.
 
+Model::Model(const PointCloud<3, float>& _positions, std::vector<glm::uvec3> _triangles) :
+	positions(_positions.points()), triangles(std::move(_triangles)) {}
+
 Model::Model(const Model& _other) = default;
 
 Model::Model(Model&& _other) noexcept : positions(std::move(_other.positions)), triangles(std::move(_other.triangles)) {}
@@ -127,3 +130,11 @@ void Model::apply_scaling(double scaling = 1.0, bool center_before_scaling = tru
 		this->apply_translation(glm::to_vec(center));
 	}
 }
+
+PointCloud<3, float> Model::position_cloud() const {
+	return PointCloud<3, float>(this->positions);
+}
+
+void Model::set_positions(const PointCloud<3, float>& cloud) {
+	cloud.copy_to(this->positions);
+}
@@ -0,0 +1,372 @@
+#pragma once
+/*
+  Copyright (c) 2019 CNRS
+  Nicolas Bonneel <nicolas.bonneel@liris.cnrs.fr>
+  David Coeurjolly <david.coeurjolly@liris.cnrs.fr>
+
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIEDi
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Sort of the projections of a slice, by a stable LSD radix sort on order-preserving integer keys. The result is the
+// order of sorting (projection, index) pairs : by increasing projection, then by increasing index for equal ones.
+// Floats are packed with their index into a single 64-bit word ; doubles are sorted as (64-bit key, index) pairs.
+// When the same directions come back (the seeded slices of correspondencesNd(), the direction bank of the barycenters),
+// warm_sort_projections() repairs the permutation of the previous sort instead.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+/// @brief Order-preserving unsigned keys of floating-point projections, and the items the radix sort moves around.
+/// @details The key of x is its bit pattern with the sign bit flipped for positive values, and all bits flipped for
+/// negative ones : unsigned comparisons of keys are the comparisons of the values. -0 is sorted as +0, as comparisons
+/// do. NaNs are not supported.
+template<typename T>
+struct RadixKey;
+
+template<>
+struct RadixKey<float> {
+	static constexpr int key_bits = 32;
+	typedef uint64_t item_t; ///< The key in the high 32 bits, the index in the low ones.
+
+	static inline item_t make(float x, int index) {
+		x += 0.f; // -0 -> +0
+		uint32_t b;
+		std::memcpy(&b, &x, sizeof(b));
+		const uint32_t key = (b & 0x80000000u) ? ~b : (b | 0x80000000u);
+		return (static_cast<uint64_t>(key) << 32) | static_cast<uint32_t>(index);
+	}
+	static inline uint32_t key(const item_t& item) { return static_cast<uint32_t>(item >> 32); }
+	static inline int index(const item_t& item) { return static_cast<int>(static_cast<uint32_t>(item)); }
+	static inline float value(const item_t& item) {
+		const uint32_t k = key(item);
+		const uint32_t b = (k & 0x80000000u) ? (k & 0x7fffffffu) : ~k;
+		float x;
+		std::memcpy(&x, &b, sizeof(x));
+		return x;
+	}
+};
+
+template<>
+struct RadixKey<double> {
+	static constexpr int key_bits = 64;
+	struct item_t {
+		uint64_t key;
+		int index;
+	};
+
+	static inline item_t make(double x, int index) {
+		x += 0.; // -0 -> +0
+		uint64_t b;
+		std::memcpy(&b, &x, sizeof(b));
+		return item_t{(b & 0x8000000000000000ull) ? ~b : (b | 0x8000000000000000ull), index};
+	}
+	static inline uint64_t key(const item_t& item) { return item.key; }
+	static inline int index(const item_t& item) { return item.index; }
+	static inline double value(const item_t& item) {
+		const uint64_t b = (item.key & 0x8000000000000000ull) ? (item.key & 0x7fffffffffffffffull) : ~item.key;
+		double x;
+		std::memcpy(&x, &b, sizeof(x));
+		return x;
+	}
+};
+
+/// @brief Caller-owned buffers of radix_sort_projections(), to be reused across slices.
+/// @details A workspace must not be used by two calls at the same time.
+/// @tparam T The data type of the projections.
+template<typename T>
+struct RadixSortWorkspace {
+	std::vector<typename RadixKey<T>::item_t> items; ///< The items being sorted.
+	std::vector<typename RadixKey<T>::item_t> buffer; ///< The items of the previous pass.
+	std::vector<int> histograms; ///< The digit histogram of each thread, then the offsets it scatters to.
+	std::vector<std::pair<T, int> > displaced; ///< The (projection, index) pairs out of order, in warm_sort_projections().
+};
+
+/// @brief Width of the digits of radix_sort_projections() : 3 passes for floats, 6 for doubles.
+constexpr int radix_sort_bits = 11;
+
+/// @brief Sorts of at least this many projections are split among the OpenMP threads.
+constexpr int radix_sort_parallel_size = 1 << 16;
+
+/// @brief Sorts n projections, in the order of sorting (projection, index) pairs with std::sort.
+/// @details Each pass counts the digits of a contiguous chunk of items per thread, and scatters the chunk at the offsets
+/// of the (digit, thread) pairs : the sort is stable, and does not depend on the number of threads. Passes whose digit
+/// is the same for all items are skipped (often the high bits, for projections of a narrow range). Inside a parallel
+/// region (with nested parallelism disabled), the sort runs on the calling thread only.
+/// @param values The n projections to sort.
+/// @param n The number of projections.
+/// @param sorted Receives the sorted projections.
+/// @param order Receives the index in values of each sorted projection.
+/// @param workspace The caller-owned buffers to use.
+template<typename T>
+void radix_sort_projections(const T* values, int n, T* sorted, int* order, RadixSortWorkspace<T>& workspace) {
+	typedef RadixKey<T> K;
+	typedef typename K::item_t item_t;
+	constexpr int buckets = 1 << radix_sort_bits;
+	constexpr int mask = buckets - 1;
+
+	workspace.items.resize(n);
+	workspace.buffer.resize(n);
+	const int max_threads = n >= radix_sort_parallel_size ? omp_get_max_threads() : 1;
+	workspace.histograms.resize(static_cast<std::size_t>(max_threads) * buckets);
+	item_t* src = workspace.items.data();
+	item_t* dst = workspace.buffer.data();
+	int* histograms = workspace.histograms.data();
+	bool skip = false;
+
+#pragma omp parallel num_threads(max_threads)
+	{
+		const int thread = omp_get_thread_num();
+		const int nthreads = omp_get_num_threads();
+		const int begin = static_cast<int>(static_cast<long long>(n) * thread / nthreads);
+		const int end = static_cast<int>(static_cast<long long>(n) * (thread + 1) / nthreads);
+		int* histogram = histograms + static_cast<std::size_t>(thread) * buckets;
+
+		for (int i = begin; i < end; i++) {
+			src[i] = K::make(values[i], i);
+		}
+
+		for (int shift = 0; shift < K::key_bits; shift += radix_sort_bits) {
+			std::fill(histogram, histogram + buckets, 0);
+			for (int i = begin; i < end; i++) {
+				histogram[(K::key(src[i]) >> shift) & mask]++;
+			}
+		#pragma omp barrier
+		#pragma omp single
+			{
+				skip = false;
+				for (int b = 0; b < buckets && !skip; b++) {
+					int count = 0;
+					for (int t = 0; t < nthreads; t++) {
+						count += histograms[t * buckets + b];
+					}
+					skip = count == n;
+				}
+				if (!skip) {
+					int offset = 0;
+					for (int b = 0; b < buckets; b++) {
+						for (int t = 0; t < nthreads; t++) {
+							const int count = histograms[t * buckets + b];
+							histograms[t * buckets + b] = offset;
+							offset += count;
+						}
+					}
+				}
+			}
+			if (!skip) {
+				for (int i = begin; i < end; i++) {
+					dst[histogram[(K::key(src[i]) >> shift) & mask]++] = src[i];
+				}
+			#pragma omp barrier
+			#pragma omp single
+				std::swap(src, dst);
+			}
+		}
+
+		for (int i = begin; i < end; i++) {
+			sorted[i] = K::value(src[i]);
+			order[i] = K::index(src[i]);
+		}
+	}
+}
+
+/// @brief The permutations of the previous sorts on a fixed set of directions, to warm-start the next sorts on them.
+/// @details At most max_bytes of permutations are kept : the slots beyond are sorted from scratch every time.
+struct WarmSortCache {
+	/// @brief Makes sure there are slots for the given number of directions. Not thread-safe.
+	void reserve(int slots) {
+		if (static_cast<int>(this->orders.size()) < slots) {
+			this->orders.resize(slots);
+		}
+	}
+
+	std::vector<std::vector<int> > orders; ///< The last permutation of each slot, empty if none.
+	std::size_t max_bytes = std::size_t(256) << 20; ///< Memory cap of the permutations.
+	std::size_t bytes = 0; ///< Memory used by the permutations.
+};
+
+/// @brief The repair of warm_sort_projections() falls back to radix_sort_projections() when more than one in this many
+/// projections are out of order.
+constexpr int warm_sort_max_displaced_ratio = 16;
+
+/// @brief radix_sort_projections(), warm-started from the permutation of the previous sort on the same direction.
+/// @details The projections are visited in their previous order. Each time one is smaller than the last one kept, both
+/// are set aside : the kept ones stay sorted, and at most twice as many as the descents are set aside. Those are sorted
+/// and merged back, in O(n + d log d) for d displaced projections. If too many are, or without a previous permutation
+/// of n projections, this is radix_sort_projections(). The result is the same in all cases. Different slots of the
+/// cache may be sorted concurrently (with different workspaces), not the same one.
+/// @param values The n projections to sort.
+/// @param n The number of projections.
+/// @param sorted Receives the sorted projections.
+/// @param order Receives the index in values of each sorted projection. It is also stored in the cache.
+/// @param workspace The caller-owned buffers to use.
+/// @param cache The previous permutations.
+/// @param slot The direction of the projections, in the cache. Must be less than the slots reserved.
+template<typename T>
+void warm_sort_projections(const T* values, int n, T* sorted, int* order, RadixSortWorkspace<T>& workspace, WarmSortCache& cache, int slot) {
+	std::vector<int>& previous = cache.orders[slot];
+	bool repaired = false;
+	if (static_cast<int>(previous.size()) == n && n > 0) {
+		std::vector<std::pair<T, int> >& displaced = workspace.displaced;
+		displaced.clear();
+		const std::size_t max_displaced = n / warm_sort_max_displaced_ratio;
+		int kept = 0;
+		for (int i = 0; i < n && displaced.size() <= max_displaced; i++) {
+			const int index = previous[i];
+			const T value = values[index] + T(0); // -0 -> +0, as radix_sort_projections()
+			if (kept > 0 && (value < sorted[kept - 1] || (value == sorted[kept - 1] && index < order[kept - 1]))) {
+				kept--;
+				displaced.push_back(std::make_pair(sorted[kept], order[kept]));
+				displaced.push_back(std::make_pair(value, index));
+			} else {
+				sorted[kept] = value;
+				order[kept] = index;
+				kept++;
+			}
+		}
+		if (displaced.size() <= max_displaced) {
+			std::sort(displaced.begin(), displaced.end());
+			// Merges from the end : the kept projections are in place.
+			int d = static_cast<int>(displaced.size()) - 1;
+			for (int k = n - 1; d >= 0; k--) {
+				if (kept > 0 && std::make_pair(sorted[kept - 1], order[kept - 1]) > displaced[d]) {
+					kept--;
+					sorted[k] = sorted[kept];
+					order[k] = order[kept];
+				} else {
+					sorted[k] = displaced[d].first;
+					order[k] = displaced[d].second;
+					d--;
+				}
+			}
+			repaired = true;
+		}
+	}
+	if (!repaired) {
+		radix_sort_projections(values, n, sorted, order, workspace);
+	}
+
+	if (static_cast<int>(previous.size()) != n) {
+		const std::size_t old_bytes = previous.size() * sizeof(int);
+		const std::size_t new_bytes = static_cast<std::size_t>(n) * sizeof(int);
+		bool fits;
+	#pragma omp critical(spot_warm_sort_cache)
+		{
+			fits = cache.bytes - old_bytes + new_bytes <= cache.max_bytes;
+			if (fits) {
+				cache.bytes = cache.bytes - old_bytes + new_bytes;
+			}
+		}
+		if (!fits) {
+			return;
+		}
+		previous.resize(n);
+	}
+	std::copy(order, order + n, previous.begin());
+}
+
+/// @brief Caller-owned buffers of counting_sort() and sort_quantized_projections(), to be reused across slices.
+struct CountingSortWorkspace {
+	static constexpr int buckets = 65536; ///< Number of distinct 16-bit keys.
+
+	std::vector<int> histograms; ///< The key histogram of each thread, then the offsets it scatters to.
+	std::vector<int> totals; ///< The number of keys of each value, over all threads, then their first offset.
+};
+
+/// @brief The counting and scattering of counting_sort(), called by all the threads of a parallel region.
+/// @details Each thread counts the keys of its contiguous chunk [begin, end), and scatters them at the offsets of the
+/// (key, thread) pairs : the sort is stable, and does not depend on the number of threads. The offsets are computed by
+/// ranges of keys, in parallel.
+inline void counting_sort_chunk(const uint16_t* keys, int begin, int end, int* order, CountingSortWorkspace &workspace) {
+	constexpr int buckets = CountingSortWorkspace::buckets;
+	const int thread = omp_get_thread_num();
+	const int nthreads = omp_get_num_threads();
+	int* histograms = workspace.histograms.data();
+	int* histogram = histograms + static_cast<std::size_t>(thread) * buckets;
+	int* totals = workspace.totals.data();
+
+	std::fill(histogram, histogram + buckets, 0);
+	for (int i = begin; i < end; i++) {
+		histogram[keys[i]]++;
+	}
+#pragma omp barrier
+	const int first_key = static_cast<int>(static_cast<long long>(buckets) * thread / nthreads);
+	const int last_key = static_cast<int>(static_cast<long long>(buckets) * (thread + 1) / nthreads);
+	for (int k = first_key; k < last_key; k++) {
+		int count = 0;
+		for (int t = 0; t < nthreads; t++) {
+			count += histograms[static_cast<std::size_t>(t) * buckets + k];
+		}
+		totals[k] = count;
+	}
+#pragma omp barrier
+#pragma omp single
+	{
+		int offset = 0;
+		for (int k = 0; k < buckets; k++) {
+			const int count = totals[k];
+			totals[k] = offset;
+			offset += count;
+		}
+	}
+	for (int k = first_key; k < last_key; k++) {
+		int offset = totals[k];
+		for (int t = 0; t < nthreads; t++) {
+			const int count = histograms[static_cast<std::size_t>(t) * buckets + k];
+			histograms[static_cast<std::size_t>(t) * buckets + k] = offset;
+			offset += count;
+		}
+	}
+#pragma omp barrier
+	for (int i = begin; i < end; i++) {
+		order[histogram[keys[i]]++] = i;
+	}
+#pragma omp barrier
+}
+
+/// @brief Stable counting sort of 16-bit keys.
+/// @details Sorts of at least radix_sort_parallel_size keys are split among the OpenMP threads (see
+/// counting_sort_chunk()). Inside a parallel region (with nested parallelism disabled), the sort runs on the calling
+/// thread only.
+/// @param keys The n keys to sort.
+/// @param n The number of keys.
+/// @param order Receives the indices of the keys, by increasing key, then by increasing index for equal keys : the same
+/// order as sorting (key, index) pairs.
+/// @param workspace The caller-owned buffers to use. Pass the same one across calls.
+inline void counting_sort(const uint16_t* keys, int n, int* order, CountingSortWorkspace &workspace) {
+	const int max_threads = n >= radix_sort_parallel_size ? omp_get_max_threads() : 1;
+	workspace.histograms.resize(static_cast<std::size_t>(max_threads) * CountingSortWorkspace::buckets);
+	workspace.totals.resize(CountingSortWorkspace::buckets);
+#pragma omp parallel num_threads(max_threads)
+	{
+		const int thread = omp_get_thread_num();
+		const int nthreads = omp_get_num_threads();
+		const int begin = static_cast<int>(static_cast<long long>(n) * thread / nthreads);
+		const int end = static_cast<int>(static_cast<long long>(n) * (thread + 1) / nthreads);
+		counting_sort_chunk(keys, begin, end, order, workspace);
+	}
+}
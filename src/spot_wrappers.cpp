@@ -29,6 +29,21 @@ namespace spot_wrappers {
 			pybind11::array::handle()
 		);
 	}
+
+	PointCloud<3, float> tensor_to_point_cloud(const point_tensor_t& source) {
+		if (source.ndim() != 2 || source.shape(1) != 3) {
+			throw std::invalid_argument(fmt::format("Expected an array of shape (N, 3), got {} dimensions.", source.ndim()));
+		}
+		const auto samples = source.unchecked<2>();
+		PointCloud<3, float> cloud(static_cast<int>(samples.shape(0)));
+		for (int c = 0; c < 3; ++c) {
+			float* coords = cloud.coord(c);
+			for (ssize_t i = 0; i < samples.shape(0); ++i) {
+				coords[i] = samples(i, c);
+			}
+		}
+		return cloud;
+	}
 	//endregion
 
 	//region --- FIST_BaseWrapper implementation ---
@@ -39,6 +54,14 @@ namespace spot_wrappers {
 		this->timings = nullptr;
 		this->maximum_iterations = 200;
 		this->maximum_directions = 100;
+		this->direction_sampling = DirectionSampling::gaussian;
+		this->num_threads = 0;
+		this->advection_batch = 1;
+		this->rotation_tolerance = 0;
+		this->translation_tolerance = 0;
+		this->scaling_tolerance = 0;
+		this->performed_iterations = 0;
+		this->fused_moments = false;
 	}
 
 	FIST_BaseWrapper::~FIST_BaseWrapper() {
@@ -54,6 +77,24 @@ namespace spot_wrappers {
 		return point_vector_to_tensor(this->get_target_distribution());
 	}
 
+	PointCloud<3, float> FIST_BaseWrapper::get_source_point_cloud() const {
+		return PointCloud<3, float>(this->get_source_distribution());
+	}
+
+	PointCloud<3, float> FIST_BaseWrapper::get_target_point_cloud() const {
+		return PointCloud<3, float>(this->get_target_distribution());
+	}
+
+	void FIST_BaseWrapper::set_source_point_cloud(const PointCloud<3, float>& cloud) {
+		fmtdbg("FIST_BaseWrapper::set_source_point_cloud() : {} samples", cloud.size());
+		cloud.copy_to(this->get_source_distribution());
+	}
+
+	void FIST_BaseWrapper::set_target_point_cloud(const PointCloud<3, float>& cloud) {
+		fmtdbg("FIST_BaseWrapper::set_target_point_cloud() : {} samples", cloud.size());
+		cloud.copy_to(this->get_target_distribution());
+	}
+
 	std::uint32_t FIST_BaseWrapper::get_source_distribution_size() const {
 		return static_cast<std::uint32_t>(this->get_source_distribution().size());
 	}
@@ -103,6 +144,14 @@ namespace spot_wrappers {
 		}
 	}
 
+	micro_benchmarks::TransportStats FIST_BaseWrapper::get_transport_stats() const {
+		if (this->timings) {
+			return this->timings->get_transport_stats();
+		} else {
+			return micro_benchmarks::TransportStats();
+		}
+	}
+
 	void FIST_BaseWrapper::set_maximum_iterations(const std::uint32_t new_iterations_max) {
 		fmtdbg("FIST_BaseWrapper::set_maximum_iterations() : setting {} to {}", this->maximum_iterations, new_iterations_max);
 		this->maximum_iterations = new_iterations_max;
@@ -113,6 +162,53 @@ namespace spot_wrappers {
 		this->maximum_directions = new_directions_max;
 	}
 
+	void FIST_BaseWrapper::set_direction_sampling(const DirectionSampling new_sampling) {
+		fmtdbg("FIST_BaseWrapper::set_direction_sampling() : setting {} to {}", static_cast<int>(this->direction_sampling), static_cast<int>(new_sampling));
+		this->direction_sampling = new_sampling;
+	}
+
+	DirectionSampling FIST_BaseWrapper::get_direction_sampling() const {
+		return this->direction_sampling;
+	}
+
+	void FIST_BaseWrapper::set_num_threads(const int new_num_threads) {
+		fmtdbg("FIST_BaseWrapper::set_num_threads() : setting {} to {}", this->num_threads, new_num_threads);
+		this->num_threads = std::max(new_num_threads, 0);
+	}
+
+	int FIST_BaseWrapper::get_num_threads() const {
+		return this->num_threads;
+	}
+
+	void FIST_BaseWrapper::set_advection_batch(const int new_advection_batch) {
+		fmtdbg("FIST_BaseWrapper::set_advection_batch() : setting {} to {}", this->advection_batch, new_advection_batch);
+		this->advection_batch = std::max(new_advection_batch, 1);
+	}
+
+	int FIST_BaseWrapper::get_advection_batch() const {
+		return this->advection_batch;
+	}
+
+	void FIST_BaseWrapper::set_convergence_tolerances(const double rotation, const double translation, const double scaling) {
+		fmtdbg("FIST_BaseWrapper::set_convergence_tolerances() : setting {}, {}, {}", rotation, translation, scaling);
+		this->rotation_tolerance = std::max(rotation, 0.);
+		this->translation_tolerance = std::max(translation, 0.);
+		this->scaling_tolerance = std::max(scaling, 0.);
+	}
+
+	std::uint32_t FIST_BaseWrapper::get_performed_iterations() const {
+		return this->performed_iterations;
+	}
+
+	void FIST_BaseWrapper::set_fused_moments(const bool new_fused_moments) {
+		fmtdbg("FIST_BaseWrapper::set_fused_moments() : setting {} to {}", this->fused_moments, new_fused_moments);
+		this->fused_moments = new_fused_moments;
+	}
+
+	bool FIST_BaseWrapper::get_fused_moments() const {
+		return this->fused_moments;
+	}
+
 	glm::mat4 FIST_BaseWrapper::get_computed_matrix() const {
 		return this->computed_transform;
 	}
@@ -124,6 +220,16 @@ namespace spot_wrappers {
 	double FIST_BaseWrapper::get_computed_scaling() const {
 		return this->computed_scaling;
 	}
+
+	void FIST_BaseWrapper::configure(UnbalancedSliced& sliced) const {
+		sliced.direction_sampling = this->direction_sampling;
+		sliced.num_threads = this->num_threads;
+		sliced.advection_batch = this->advection_batch;
+		sliced.fist_rotation_tolerance = this->rotation_tolerance;
+		sliced.fist_translation_tolerance = this->translation_tolerance;
+		sliced.fist_scaling_tolerance = this->scaling_tolerance;
+		sliced.fist_fused_moments = this->fused_moments;
+	}
 	//endregion
 
 	//region --- FISTWrapperRandomModels implementation ---
@@ -150,6 +256,7 @@ namespace spot_wrappers {
 	void FISTWrapperRandomModels::compute_transformation(bool enable_timings) {
 		fmtdbg("FISTWrapperRandomModels::compute_transformation({})", enable_timings);
 		UnbalancedSliced sliced;
+		this->configure(sliced);
 		std::vector<double> rot(9);
 		std::vector<double> trans(3);
 		double scaling;
@@ -162,6 +269,7 @@ namespace spot_wrappers {
 			this->source_distribution, this->target_distribution,
 			rot, trans, true, scaling, std::move(this->timings)
 		);
+		this->performed_iterations = static_cast<std::uint32_t>(sliced.fist_iterations);
 		this->computed_transform = glm::mat4{
 			rot[0], rot[1], rot[2], 0.0f,
 			rot[3], rot[4], rot[5], 0.0f,
@@ -173,7 +281,7 @@ namespace spot_wrappers {
 		fmt::print("Registration done.\n");
 		if (enable_timings) {
 			this->timings->print_timings(
-				fmt::format("After registering {} to {} points, transformation is :", this->src_size, this->tgt_size),
+				fmt::format("After registering {} to {} points, transformation is :", this->source_distribution.size(), this->target_distribution.size()),
 				"[Final transformation :]");
 		}
 	}
@@ -236,6 +344,7 @@ namespace spot_wrappers {
 	void FISTWrapperSameModel::compute_transformation(bool enable_timings) {
 		fmtdbg("FISTWrapperSameModel::compute_transformation()");
 		UnbalancedSliced sliced;
+		this->configure(sliced);
 		std::vector<double> rot(9);
 		std::vector<double> trans(3);
 		double scaling;
@@ -248,6 +357,7 @@ namespace spot_wrappers {
 			this->source_model->positions, this->target_model->positions,
 			rot, trans, false, scaling, std::move(this->timings)
 		);
+		this->performed_iterations = static_cast<std::uint32_t>(sliced.fist_iterations);
 		this->computed_transform = glm::mat4{
 			rot[0], rot[1], rot[2], 0.0f,
 			rot[3], rot[4], rot[5], 0.0f,
@@ -308,6 +418,7 @@ namespace spot_wrappers {
 
 	void FISTWrapperDifferentModels::compute_transformation(bool enable_timings) {
 		UnbalancedSliced sliced;
+		this->configure(sliced);
 		std::vector<double> rot(9);
 		std::vector<double> trans(3);
 		double scaling;
@@ -320,6 +431,7 @@ namespace spot_wrappers {
 			this->source_model->positions, this->target_model->positions,
 			rot, trans, true, scaling, std::move(this->timings)
 		);
+		this->performed_iterations = static_cast<std::uint32_t>(sliced.fist_iterations);
 		this->computed_transform = glm::mat4{
 			rot[0], rot[1], rot[2], 0.0f,
 			rot[3], rot[4], rot[5], 0.0f,
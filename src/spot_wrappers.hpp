@@ -49,6 +49,10 @@ namespace spot_wrappers {
 	/// @returns A pybind11::array_t with the right size and data to represent the given vector in python.
 	point_tensor_t point_vector_to_tensor(const std::vector<Point<3, float>>& source);
 
+	/// @brief Copies the rows of a (N, 3) array into a point cloud stored by coordinate.
+	/// @throws std::invalid_argument if the array is not of shape (N, 3).
+	PointCloud<3, float> tensor_to_point_cloud(const point_tensor_t& source);
+
 	/// @brief Base class for the wrappers around the FIST method.
 	/// @note This class is not meant to be created directly. Its sub-classes are.
 	class SPOT_EXPORT FIST_BaseWrapper {
@@ -78,6 +82,15 @@ namespace spot_wrappers {
 		/// @brief Returns a const reference to the target distribution.
 		virtual const std::vector<Point<3, float>>& get_target_distribution() const = 0;
 
+		/// @brief Returns a copy of the source distribution, stored by coordinate.
+		PointCloud<3, float> get_source_point_cloud() const;
+		/// @brief Returns a copy of the target distribution, stored by coordinate.
+		PointCloud<3, float> get_target_point_cloud() const;
+		/// @brief Replaces the source distribution by the given samples, stored by coordinate.
+		void set_source_point_cloud(const PointCloud<3, float>& cloud);
+		/// @brief Replaces the target distribution by the given samples, stored by coordinate.
+		void set_target_point_cloud(const PointCloud<3, float>& cloud);
+
 		/// @brief Returns the size of the source distribution. Used for information in Python's ``__repr__`` function.
 		std::uint32_t get_source_distribution_size() const;
 		/// @brief Returns the size of the target distribution. Used for information in Python's ``__repr__`` function.
@@ -95,11 +108,34 @@ namespace spot_wrappers {
 		const micro_benchmarks::TimingsLogger get_timings() const;
 		/// @brief Prints the timings computed, if available.
 		void print_timings(const char* message, const char* prefix) const;
+		/// @brief Returns the statistics of the 1D transports of the last timed run, or all zeroes if not available.
+		micro_benchmarks::TransportStats get_transport_stats() const;
 
 		/// @brief Sets the new maximum number of iterations available for registrations.
 		void set_maximum_iterations(std::uint32_t new_iterations_max);
 		/// @brief Sets the new maximum number of directions evaluated at each iteration of the registration.
 		void set_maximum_directions(std::uint32_t new_directions_max);
+		/// @brief Sets how the directions evaluated at each iteration of the registration are drawn.
+		void set_direction_sampling(DirectionSampling new_sampling);
+		/// @brief Gets how the directions evaluated at each iteration of the registration are drawn.
+		DirectionSampling get_direction_sampling() const;
+		/// @brief Sets the number of threads of the registration, or 0 to use the OpenMP setting.
+		void set_num_threads(int new_num_threads);
+		/// @brief Gets the number of threads of the registration, or 0 if it uses the OpenMP setting.
+		int get_num_threads() const;
+		/// @brief Sets the number of slices solved at once, against the same source, at each registration step.
+		void set_advection_batch(int new_advection_batch);
+		/// @brief Gets the number of slices solved at once, against the same source, at each registration step.
+		int get_advection_batch() const;
+		/// @brief Sets the rotation angle (in radians), translation and scaling change of a registration step under which
+		/// the registration stops before the maximum number of iterations. 0 does not check a criterion.
+		void set_convergence_tolerances(double rotation, double translation, double scaling);
+		/// @brief Gets the number of iterations the last registration performed.
+		std::uint32_t get_performed_iterations() const;
+		/// @brief Sets whether the registration steps compute their centers and covariance in a single parallel pass.
+		void set_fused_moments(bool new_fused_moments);
+		/// @brief Gets whether the registration steps compute their centers and covariance in a single parallel pass.
+		bool get_fused_moments() const;
 
 		/// @brief Gets the currently computed rotation/scale matrix.
 		/// @returns Either a identity matrix if it has not been computed, or the computed matrix.
@@ -110,10 +146,21 @@ namespace spot_wrappers {
 		double get_computed_scaling() const;
 
 	protected:
+		/// @brief Copies the registration settings of this wrapper into the given solver.
+		void configure(UnbalancedSliced& sliced) const;
+
 		std::unique_ptr<micro_benchmarks::TimingsLogger> timings; ///< The benchmark logger, to keep track of the execution times.
 
 		std::uint32_t maximum_iterations; ///< The maximum number of iterations available for registration steps.
 		std::uint32_t maximum_directions; ///< The maximum number of directions evaluated at each registration step.
+		DirectionSampling direction_sampling; ///< How the directions evaluated at each registration step are drawn.
+		int num_threads; ///< The number of threads of the registration, or 0 to use the OpenMP setting.
+		int advection_batch; ///< The number of slices solved at once against the same source, 1 to move it after each slice.
+		double rotation_tolerance; ///< The rotation angle of a registration step under which the registration stops, or 0.
+		double translation_tolerance; ///< The translation of a registration step under which the registration stops, or 0.
+		double scaling_tolerance; ///< The scaling change of a registration step under which the registration stops, or 0.
+		std::uint32_t performed_iterations; ///< The number of iterations the last registration performed.
+		bool fused_moments; ///< Whether the registration steps compute their centers and covariance in a single parallel pass.
 
 		glm::mat4 computed_transform;	///< The computed transform for the current instance of this class, or identity<glm::mat4>() beforehand.
 		glm::vec4 computed_translation;	///< The computed translation for the current instance of this class, or a null vector beforehand.
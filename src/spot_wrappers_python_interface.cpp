@@ -4,6 +4,8 @@
 
 #include "spot_wrappers.hpp"
 
+#include <pybind11/stl.h>
+
 #define STRINGIFY(x) #x
 #define MACRO_STRINGIFY(x) STRINGIFY(x)
 
@@ -16,6 +18,7 @@ PYBIND11_MODULE(_spot, spot_module) {
 	// Typedefs to the types to wrap :
 	using Stats = micro_benchmarks::TimeSeriesStatistics;
 	using Timings = micro_benchmarks::TimingsLogger;
+	using TransportStats = micro_benchmarks::TransportStats;
 	using FISTBase = spot_wrappers::FIST_BaseWrapper;
 	using FISTRandom = spot_wrappers::FISTWrapperRandomModels;
 	using FISTSame = spot_wrappers::FISTWrapperSameModel;
@@ -35,6 +38,13 @@ PYBIND11_MODULE(_spot, spot_module) {
 		.doc() = "Enables reproducible runs : sets the random engine to be initialized with a constant value instead of a timestamp.";
 	spot_module.def("disable_reproducible_runs", [](){ spot_wrappers::set_enable_reproducible_runs(false); })
 		.doc() = "Disables reproducible runs : sets the random engine to be initialized with a timestamp instead of a constant value.";
+	spot_module.def("simd_instruction_set", [](){ return std::string(simd::isa_name(simd::active_isa())); })
+		.doc() = "Returns the instruction set used by the SIMD kernels on this machine : scalar, sse4.2, avx2 or avx512.";
+	spot_module.attr("transport_stats_enabled") = micro_benchmarks::transport_stats_enabled;
+	pybind11::enum_<DirectionSampling>(spot_module, "DirectionSampling", "How the directions of the slices are drawn.")
+		.value("gaussian", DirectionSampling::gaussian, "Independent directions, uniformly distributed on the sphere.")
+		.value("orthogonal_frames", DirectionSampling::orthogonal_frames, "Blocks of mutually orthogonal directions, each a random rotation.")
+		.value("low_discrepancy", DirectionSampling::low_discrepancy, "A deterministic set covering the half-sphere evenly.");
 
 	/* ------------------------ */
 	/* Declare used GLM types : */
@@ -67,6 +77,31 @@ PYBIND11_MODULE(_spot, spot_module) {
 		.def_property_readonly("percentile_99", 		[&](const Stats& stats) { return duration_to_time(stats.percentile_99); })
 		.def_property_readonly("total_running_time", 	[&](const Stats& stats) { return coarse_to_time(stats.total_running_time); })
 		.doc() = "A simple structure to get some stats from a time series.";
+	pybind11::class_<TransportStats>(spot_module, "TransportStats")
+		.def_readonly("slices", 							&TransportStats::slices)
+		.def_readonly("slices_balanced", 					&TransportStats::slices_balanced)
+		.def_readonly("slices_solved_by_reduce_range", 		&TransportStats::slices_solved_by_reduce_range)
+		.def_readonly("slices_not_split", 					&TransportStats::slices_not_split)
+		.def_readonly("size_one_splits", 					&TransportStats::size_one_splits)
+		.def_readonly("subproblems", 						&TransportStats::subproblems)
+		.def_readonly("solved_equal_sizes", 				&TransportStats::solved_equal_sizes)
+		.def_readonly("solved_one_free_target", 			&TransportStats::solved_one_free_target)
+		.def_readonly("solved_single_source", 				&TransportStats::solved_single_source)
+		.def_readonly("solved_injective_nearest_neighbors",	&TransportStats::solved_injective_nearest_neighbors)
+		.def_readonly("solved_by_reduce_range", 			&TransportStats::solved_by_reduce_range)
+		.def_readonly("solved_by_simple_solve", 			&TransportStats::solved_by_simple_solve)
+		.def_readonly("solved_approximately", 				&TransportStats::solved_approximately)
+		.def_readonly("largest_simple_solve_M", 			&TransportStats::largest_simple_solve_M)
+		.def_readonly("largest_simple_solve_N", 			&TransportStats::largest_simple_solve_N)
+		.def_property_readonly("subproblem_sizes", [](const TransportStats& stats) {
+			return std::vector<std::uint64_t>(std::begin(stats.subproblem_sizes), std::end(stats.subproblem_sizes));
+		}, pydoc("Histogram of the sub-problem sizes : bucket k counts the sub-problems of [2^k, 2^(k+1)) source samples."))
+		.def_property_readonly("nearest_neighbor_time", 	[&](const TransportStats& stats) { return duration_to_time(stats.nearest_neighbor_time); })
+		.def_property_readonly("reduce_range_time", 		[&](const TransportStats& stats) { return duration_to_time(stats.reduce_range_time); })
+		.def_property_readonly("decomposition_time", 		[&](const TransportStats& stats) { return duration_to_time(stats.decomposition_time); })
+		.def_property_readonly("subproblems_time", 			[&](const TransportStats& stats) { return duration_to_time(stats.subproblems_time); })
+		.def("print", &TransportStats::print, "prefix"_a = "", pydoc("Prints the counters, each line starting with prefix."))
+		.doc() = "Counters of the paths taken by the 1D solver. All zero unless the module was built with SPOT_ENABLE_TRANSPORT_STATS.";
 	pybind11::class_<Timings>(spot_module, "TimingsLogger", pybind11::buffer_protocol())
 	    .def(pybind11::init<unsigned int>(), "pre_allocated_laps"_a, pydoc("Allocates a timer with enough \"spots\" to keep all iteration times in memory"))
 		.def("start", &Timings::start_lap, pydoc("Starts a lap on the timer."))
@@ -76,6 +111,8 @@ PYBIND11_MODULE(_spot, spot_module) {
 			return stats != nullptr ? *stats : micro_benchmarks::TimeSeriesStatistics();
 		}, pydoc("Returns the computed statistics for this chronometer, if any."))
 		.def("compute_stats", &Timings::compute_timing_stats, pydoc("Computes the timing statistics for this timer."))
+		.def_property_readonly("transport_stats", [](const Timings& timings) { return timings.get_transport_stats(); },
+				pydoc("Returns the statistics of the 1D transports recorded during the timed run."))
 		.def("print_timings", &Timings::print_timings,
 				"banner_message"_a = "Timings for the current registration",
 				"message_prefix"_a = "",
@@ -113,10 +150,22 @@ PYBIND11_MODULE(_spot, spot_module) {
 		//.def("get_timings", &FISTBase::get_timings)
 		.def("lap_time", &FISTBase::get_running_time, "lap_number"_a)
 		.def("print_timings", &FISTBase::print_timings, "message"_a = "", "prefix"_a = "")
+		.def_property_readonly("transport_stats", &FISTBase::get_transport_stats, pydoc("Returns the statistics of the 1D transports of the last timed registration run."))
 		.def("set_max_iterations", &FISTBase::set_maximum_iterations, "max_iterations"_a = 200)
 		.def("set_max_directions", &FISTBase::set_maximum_directions, "max_directions"_a = 100)
+		.def_property("direction_sampling", &FISTBase::get_direction_sampling, &FISTBase::set_direction_sampling, pydoc("How the directions evaluated at each registration step are drawn."))
+		.def_property("num_threads", &FISTBase::get_num_threads, &FISTBase::set_num_threads, pydoc("The number of threads of the registration, or 0 to use the OpenMP setting (OMP_NUM_THREADS)."))
+		.def_property("advection_batch", &FISTBase::get_advection_batch, &FISTBase::set_advection_batch, pydoc("The number of slices solved in parallel against the same source at each registration step, or 1 to move the source after each slice."))
+		.def("set_convergence_tolerances", &FISTBase::set_convergence_tolerances, "rotation"_a = 0., "translation"_a = 0., "scaling"_a = 0.,
+			pydoc("Stops the registration once a step rotates the source by at most rotation radians, translates it by at most translation and changes its scale by at most scaling. 0 does not check a criterion."))
+		.def_property_readonly("performed_iterations", &FISTBase::get_performed_iterations, pydoc("The number of iterations the last registration performed."))
+		.def_property("fused_moments", &FISTBase::get_fused_moments, &FISTBase::set_fused_moments, pydoc("Whether each registration step computes the centers and the covariance of the source in a single parallel pass over its samples."))
 		.def_property_readonly("source_distribution", &FISTBase::get_source_point_cloud_py, pydoc("Return the source distribution."))
 		.def_property_readonly("target_distribution", &FISTBase::get_target_point_cloud_py, pydoc("Return the target distribution."))
+		.def("set_source_distribution", [](FISTBase& fist, const spot_wrappers::point_tensor_t& points) { fist.set_source_point_cloud(spot_wrappers::tensor_to_point_cloud(points)); },
+			"points"_a, pydoc("Replaces the source distribution by the rows of a (N, 3) array."))
+		.def("set_target_distribution", [](FISTBase& fist, const spot_wrappers::point_tensor_t& points) { fist.set_target_point_cloud(spot_wrappers::tensor_to_point_cloud(points)); },
+			"points"_a, pydoc("Replaces the target distribution by the rows of a (N, 3) array."))
 		.def_property_readonly("source_distribution_size", &FISTBase::get_source_distribution_size, pydoc("Return the size of source distribution."))
 		.def_property_readonly("target_distribution_size", &FISTBase::get_target_distribution_size, pydoc("Return the size of target distribution."))
 		.def_property_readonly("running_time", &FISTBase::get_total_running_time, pydoc("Get the total running time in seconds of the last computed registration run, or 0."))
@@ -0,0 +1,57 @@
+//
+// Checks the advection by batches of slices solved in parallel (UnbalancedSliced::advection_batch) : batches of one slice
+// are the sequential advection, larger ones must bring the source close to the target, and give the same result for
+// any number of threads. FIST must then still recover a known translation.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+int main() {
+	omp_set_nested(0);
+
+	bool success = true;
+	std::mt19937 generator(20);
+	std::normal_distribution<float> normal(0.f, 1.f);
+	std::vector<Point<3, float> > source(5000), target(6000);
+	for (auto& p : source) { for (int j = 0; j < 3; ++j) { p[j] = normal(generator); } }
+	for (auto& p : target) { for (int j = 0; j < 3; ++j) { p[j] = 0.5f * normal(generator) + 2.f * (j == 0); } }
+
+	UnbalancedSliced sliced;
+	const double initial = sliced.correspondencesNd(source, target, 64);
+
+	// Batches of one slice :
+	std::vector<Point<3, float> > sequential(source), single(source);
+	sliced.correspondencesNd(sequential, target, 128, true);
+	sliced.advection_batch = 1;
+	sliced.correspondencesNd(single, target, 128, true);
+	bool same = true;
+	for (int i = 0; i < source.size(); ++i) { same &= sequential[i] == single[i]; }
+	success &= same;
+	const double distance_sequential = sliced.correspondencesNd(sequential, target, 64);
+
+	// Batches of 16 slices, with 1 and 4 threads :
+	std::vector<Point<3, float> > batched1(source), batched4(source);
+	sliced.advection_batch = 16;
+	sliced.num_threads = 1;
+	sliced.correspondencesNd(batched1, target, 128, true);
+	sliced.num_threads = 4;
+	sliced.correspondencesNd(batched4, target, 128, true);
+	for (int i = 0; i < source.size(); ++i) { same &= batched1[i] == batched4[i]; }
+	success &= same;
+	const double distance_batched = sliced.correspondencesNd(batched1, target, 64);
+	std::cout << fmt::format("Sliced distance : initially {}, after sequential advection {}, after batched advection {}",
+							 initial, distance_sequential, distance_batched) << '\n';
+	success &= distance_batched < 1e-3 * initial;
+
+	// Registration of a translated copy :
+	std::vector<Point<3, float> > translated(target);
+	for (auto& p : translated) { p[1] += 0.7f; p[2] -= 0.4f; }
+	std::vector<double> rot, trans;
+	double scaling;
+	sliced.fast_iterative_sliced_transport(30, 32, translated, target, rot, trans, false, scaling);
+	std::cout << fmt::format("Translation : {} {} {}", trans[0], trans[1], trans[2]) << '\n';
+	success &= std::abs(trans[0]) < 0.02 && std::abs(trans[1] + 0.7) < 0.02 && std::abs(trans[2] - 0.4) < 0.02;
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,65 @@
+//
+// Checks the early termination of FIST (UnbalancedSliced::fist_rotation_tolerance and the others) : with tolerances it
+// must stop before niters, at the transformation it finds by running exactly that many iterations, close to the one of
+// the full run, and the timings logger must only hold the laps performed.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+int main() {
+	omp_set_nested(0);
+
+	bool success = true;
+	std::mt19937 generator(24);
+	std::normal_distribution<float> normal(0.f, 1.f);
+	std::vector<Point<3, float> > target(4000);
+	for (auto& p : target) { p[0] = 2.f * normal(generator); p[1] = normal(generator); p[2] = 0.5f * normal(generator); }
+	// The target rotated by 0.2 radians around z, and translated :
+	std::vector<Point<3, float> > source(target);
+	const float c = std::cos(0.2f), s = std::sin(0.2f);
+	for (auto& p : source) {
+		const float x = p[0], y = p[1];
+		p[0] = c * x - s * y + 0.5f;
+		p[1] = s * x + c * y - 0.3f;
+		p[2] += 0.1f;
+	}
+
+	const int niters = 300;
+	UnbalancedSliced sliced;
+	std::vector<double> rot_full, trans_full, rot, trans, rot_fixed, trans_fixed;
+	double scaling_full, scaling, scaling_fixed;
+	std::vector<Point<3, float> > full(source);
+	sliced.fast_iterative_sliced_transport(niters, 32, full, target, rot_full, trans_full, true, scaling_full);
+	success &= sliced.fist_iterations == niters;
+
+	sliced.fist_rotation_tolerance = 1e-5;
+	sliced.fist_translation_tolerance = 1e-5;
+	sliced.fist_scaling_tolerance = 1e-5;
+	std::vector<Point<3, float> > stopped(source);
+	auto logger = std::make_unique<micro_benchmarks::TimingsLogger>(niters);
+	logger = sliced.fast_iterative_sliced_transport(niters, 32, stopped, target, rot, trans, true, scaling, std::move(logger));
+	const int iterations = sliced.fist_iterations;
+	std::cout << fmt::format("Stopped after {} iterations : scaling {} (full run {})", iterations, scaling, scaling_full) << '\n';
+	success &= iterations > 0 && iterations < niters && logger->get_iteration_times().size() == iterations;
+	double difference = std::abs(scaling - scaling_full);
+	for (int k = 0; k < 9; ++k) { difference = std::max(difference, std::abs(rot[k] - rot_full[k])); }
+	for (int k = 0; k < 3; ++k) { difference = std::max(difference, std::abs(trans[k] - trans_full[k])); }
+	std::cout << fmt::format("Largest difference with the full run : {}", difference) << '\n';
+	success &= difference < 1e-3;
+
+	// A single criterion :
+	sliced.fist_translation_tolerance = 0;
+	sliced.fist_scaling_tolerance = 0;
+	std::vector<Point<3, float> > rotation_only(source);
+	sliced.fast_iterative_sliced_transport(niters, 32, rotation_only, target, rot_fixed, trans_fixed, true, scaling_fixed);
+	success &= sliced.fist_iterations > 0 && sliced.fist_iterations <= iterations;
+
+	// The same number of iterations, without tolerances :
+	sliced.fist_rotation_tolerance = 0;
+	std::vector<Point<3, float> > fixed(source);
+	sliced.fast_iterative_sliced_transport(iterations, 32, fixed, target, rot_fixed, trans_fixed, true, scaling_fixed);
+	success &= sliced.fist_iterations == iterations && fixed == stopped && rot_fixed == rot && trans_fixed == trans && scaling_fixed == scaling;
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
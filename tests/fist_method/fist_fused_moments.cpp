@@ -0,0 +1,47 @@
+//
+// Checks the single-pass moments of FIST (UnbalancedSliced::fist_fused_moments) : the registration must find the same
+// transformation as with the sequential passes, on clouds far from the origin, and the same for any number of threads.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+int main() {
+	omp_set_nested(0);
+
+	bool success = true;
+	std::mt19937 generator(25);
+	std::normal_distribution<float> normal(0.f, 1.f);
+	// Enough samples for the parallel passes :
+	std::vector<Point<3, float> > target(UnbalancedSliced::parallel_front_end_size + 5000);
+	for (auto& p : target) { p[0] = 2.f * normal(generator) + 40.f; p[1] = normal(generator) - 25.f; p[2] = 0.5f * normal(generator) + 10.f; }
+	std::vector<Point<3, float> > source(target);
+	const float c = std::cos(0.15f), s = std::sin(0.15f);
+	for (auto& p : source) {
+		const float x = p[0] - 40.f, y = p[1] + 25.f;
+		p[0] = 1.1f * (c * x - s * y) + 40.5f;
+		p[1] = 1.1f * (s * x + c * y) - 25.3f;
+		p[2] = 1.1f * (p[2] - 10.f) + 10.1f;
+	}
+
+	UnbalancedSliced sliced;
+	std::vector<double> rot, trans, rot_fused, trans_fused, rot_fused4, trans_fused4;
+	double scaling, scaling_fused, scaling_fused4;
+	std::vector<Point<3, float> > registered(source), fused(source), fused4(source);
+	sliced.fast_iterative_sliced_transport(20, 16, registered, target, rot, trans, true, scaling);
+
+	sliced.fist_fused_moments = true;
+	sliced.num_threads = 1;
+	sliced.fast_iterative_sliced_transport(20, 16, fused, target, rot_fused, trans_fused, true, scaling_fused);
+	sliced.num_threads = 4;
+	sliced.fast_iterative_sliced_transport(20, 16, fused4, target, rot_fused4, trans_fused4, true, scaling_fused4);
+	success &= fused4 == fused && rot_fused4 == rot_fused && trans_fused4 == trans_fused && scaling_fused4 == scaling_fused;
+
+	double difference = std::abs(scaling_fused - scaling);
+	for (int k = 0; k < 9; ++k) { difference = std::max(difference, std::abs(rot_fused[k] - rot[k])); }
+	for (int k = 0; k < 3; ++k) { difference = std::max(difference, std::abs(trans_fused[k] - trans[k]) / 40.); }
+	std::cout << fmt::format("Scaling {} (sequential passes {}), largest difference {}", scaling_fused, scaling, difference) << '\n';
+	success &= difference < 1e-4 && std::abs(scaling_fused * 1.1 - 1.) < 1e-2;
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
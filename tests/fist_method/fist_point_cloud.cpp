@@ -0,0 +1,73 @@
+//
+// Checks the clouds stored by coordinate : their conversions from and to vectors of points, and that correspondencesNd(),
+// sliced_distance() and FIST give the same results on them as on the vectors of points.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+template<int DIM, typename T>
+bool same_points(const PointCloud<DIM, T>& cloud, const std::vector<Point<DIM, T> >& points) {
+	bool same = cloud.size() == points.size();
+	for (int i = 0; same && i < points.size(); ++i) {
+		for (int j = 0; j < DIM; ++j) {
+			same &= cloud[i][j] == points[i][j];
+		}
+	}
+	return same;
+}
+
+int main() {
+	omp_set_nested(0);
+
+	bool success = true;
+	std::mt19937 generator(18);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::vector<Point<3, float> > source(3001), target(4000);
+	for (auto& p : source) { for (int j = 0; j < 3; ++j) { p[j] = uniform(generator); } }
+	for (auto& p : target) { for (int j = 0; j < 3; ++j) { p[j] = 1.5f * uniform(generator) + 0.3f * j; } }
+
+	// Conversions, alignment and padding :
+	PointCloud<3, float> cloud(source);
+	bool layout = same_points(cloud, source) && cloud.points().size() == source.size() && cloud.stride() % PointCloud<3, float>::simd_lanes == 0;
+	for (int j = 0; j < 3; ++j) {
+		layout &= reinterpret_cast<std::uintptr_t>(cloud.coord(j)) % PointCloud<3, float>::simd_alignment == 0;
+		for (int i = static_cast<int>(cloud.size()); i < cloud.stride(); ++i) {
+			layout &= cloud.coord(j)[i] == 0.f;
+		}
+	}
+	PointCloud<3, float> resized(cloud);
+	resized.resize(5000);
+	layout &= resized[3000] == source[3000] && resized[4999] == Point<3, float>();
+	resized.resize(10);
+	layout &= resized.size() == 10 && resized[9] == source[9] && resized.coord(0)[10] == 0.f;
+	success &= layout;
+
+	// Same distance and advected samples :
+	UnbalancedSliced sliced;
+	std::vector<Point<3, float> > advected(source);
+	PointCloud<3, float> advected_cloud(source);
+	const PointCloud<3, float> target_cloud(target);
+	const double distance = sliced.correspondencesNd(advected, target, 20, true);
+	const double distance_cloud = sliced.correspondencesNd(advected_cloud, target_cloud, 20, true);
+	const bool same_advection = distance == distance_cloud && same_points(advected_cloud, advected);
+	std::cout << fmt::format("Advection : {} and {}", distance, distance_cloud) << '\n';
+	success &= same_advection;
+
+	const double sliced_distance = sliced.correspondencesNd(source, target, 20);
+	const double sliced_distance_cloud = sliced.correspondencesNd(cloud, target_cloud, 20);
+	std::cout << fmt::format("Sliced distance : {} and {}", sliced_distance, sliced_distance_cloud) << '\n';
+	success &= sliced_distance == sliced_distance_cloud;
+
+	// Same registration :
+	std::vector<double> rot1, trans1, rot2, trans2;
+	double scaling1, scaling2;
+	std::vector<Point<3, float> > registered(source);
+	PointCloud<3, float> registered_cloud(source);
+	sliced.fast_iterative_sliced_transport(20, 16, registered, target, rot1, trans1, true, scaling1);
+	sliced.fast_iterative_sliced_transport(20, 16, registered_cloud, target_cloud, rot2, trans2, true, scaling2);
+	std::cout << fmt::format("Scaling : {} and {}", scaling1, scaling2) << '\n';
+	success &= rot1 == rot2 && trans1 == trans2 && scaling1 == scaling2 && same_points(registered_cloud, registered);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
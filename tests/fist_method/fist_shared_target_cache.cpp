@@ -0,0 +1,53 @@
+//
+// Registers two sources against the same target with a shared cache of its sorted projections : the results must be the
+// same as without the cache, and the second registration must not add to it. The cache is then shared by registrations
+// with low-discrepancy directions, which depend on the number of slices : it must not serve the projections of 20 slices
+// to a registration on 40.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+/// @brief Runs FIST and returns its rotation, followed by its translation and scaling.
+std::vector<double> register_clouds(std::vector<Point<3, float> > source, const std::vector<Point<3, float> >& target, SortedProjectionCache<float>* cache,
+									int nslices = 20, DirectionSampling sampling = DirectionSampling::gaussian) {
+	UnbalancedSliced sliced;
+	sliced.direction_sampling = sampling;
+	std::vector<double> rot(9);
+	std::vector<double> trans(3);
+	double scaling;
+	sliced.fast_iterative_sliced_transport(30, nslices, source, target, rot, trans, true, scaling, nullptr,
+										   [](UnbalancedSliced*) -> void {}, cache);
+	rot.insert(rot.end(), trans.begin(), trans.end());
+	rot.push_back(scaling);
+	return rot;
+}
+
+int main() {
+	omp_set_nested(0);
+
+	std::mt19937 generator(21);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::vector<Point<3, float> > source1(2000), source2(1500), target(3000);
+	for (auto& p : source1) { for (int j = 0; j < 3; ++j) { p[j] = uniform(generator); } }
+	for (auto& p : source2) { for (int j = 0; j < 3; ++j) { p[j] = 0.8f * uniform(generator) + 0.5f; } }
+	for (auto& p : target) { for (int j = 0; j < 3; ++j) { p[j] = 1.2f * uniform(generator) + 0.2f * j; } }
+
+	bool success = true;
+	SortedProjectionCache<float> cache;
+	success &= register_clouds(source1, target, &cache) == register_clouds(source1, target, nullptr);
+	const std::size_t bytes = cache.bytes;
+	success &= bytes == 20 * target.size() * sizeof(float);
+	success &= register_clouds(source2, target, &cache) == register_clouds(source2, target, nullptr);
+	success &= cache.bytes == bytes;
+
+	SortedProjectionCache<float> low_discrepancy_cache;
+	for (int nslices : {20, 40}) {
+		success &= register_clouds(source1, target, &low_discrepancy_cache, nslices, DirectionSampling::low_discrepancy)
+				   == register_clouds(source1, target, nullptr, nslices, DirectionSampling::low_discrepancy);
+		success &= low_discrepancy_cache.bytes == nslices * target.size() * sizeof(float);
+	}
+	std::cout << fmt::format("Cached projections : {} bytes", cache.bytes) << '\n';
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,82 @@
+//
+// Checks the approximate 1D solver : its assignments must be injective and monotone, its cost must not be below the
+// exact one, and its extra cost must stay within the bound it returns. Finer settings must not be less accurate.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+/// @brief Solves random problems with the given settings, checks them, and returns the mean relative extra cost.
+bool check_settings(const QuantileApproximation& settings, double& mean_error) {
+	UnbalancedSliced sliced;
+	TransportWorkspace<float> workspace;
+	std::mt19937 generator(3);
+	bool success = true;
+	mean_error = 0.;
+	constexpr int problems = 100;
+	for (int problem = 0; problem < problems; ++problem) {
+		const int M = 1 + static_cast<int>(generator() % 5000);
+		const int N = M + (problem % 10 == 0 ? 0 : static_cast<int>(generator() % 5000));
+		std::normal_distribution<float> source(static_cast<float>(problem % 5) * 0.2f, 1.f), target(0.f, 1.f + 0.2f * (problem % 3));
+		float* hist1 = static_cast<float*>(malloc_simd(M * sizeof(float), 32));
+		float* hist2 = static_cast<float*>(malloc_simd(N * sizeof(float), 32));
+		for (int i = 0; i < M; ++i) { hist1[i] = source(generator); }
+		for (int i = 0; i < N; ++i) { hist2[i] = target(generator); }
+		std::sort(hist1, hist1 + M);
+		std::sort(hist2, hist2 + N);
+
+		std::vector<int> exact_assignment, assignment;
+		const double exact = sliced.transport1d(hist1, hist2, M, N, exact_assignment, workspace);
+		float bound;
+		const double approximate = sliced.approximate_transport1d(hist1, hist2, M, N, assignment, settings, bound, workspace);
+
+		bool valid = assignment.size() == static_cast<std::size_t>(M) && assignment[0] >= 0 && assignment[M - 1] < N;
+		double assigned = 0.;
+		for (int i = 0; i < M && valid; ++i) {
+			valid &= i == 0 || assignment[i] > assignment[i - 1];
+			assigned += cost(hist1[i], hist2[assignment[i]]);
+		}
+		const double tolerance = 1e-4 * std::max(approximate, 1.);
+		valid &= std::abs(assigned - approximate) <= tolerance && approximate >= exact - tolerance && approximate - exact <= bound + tolerance;
+		if (!valid) {
+			std::cout << fmt::format("Problem {} ({} x {}) : exact {}, approximate {}, bound {}", problem, M, N, exact, approximate, bound) << '\n';
+		}
+		success &= valid;
+		mean_error += (approximate - exact) / std::max(exact, 1.) / problems;
+
+		free_simd(hist1);
+		free_simd(hist2);
+	}
+	std::cout << fmt::format("grid {}, refine {} : mean relative extra cost {}", settings.grid, settings.refine, mean_error) << '\n';
+	return success;
+}
+
+int main() {
+	bool success = true;
+	QuantileApproximation coarse, fine;
+	coarse.grid = 8;
+	coarse.refine = 0;
+	fine.grid = 64;
+	fine.refine = 256;
+	double coarse_error, default_error, fine_error;
+	success &= check_settings(coarse, coarse_error);
+	success &= check_settings(QuantileApproximation(), default_error);
+	success &= check_settings(fine, fine_error);
+	success &= fine_error <= coarse_error;
+
+	// correspondencesNd() must report a bound consistent with the exact sliced distance :
+	std::mt19937 generator(9);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::vector<Point<3, float> > cloud1(3000), cloud2(5000);
+	for (auto& p : cloud1) { for (int j = 0; j < 3; ++j) { p[j] = uniform(generator); } }
+	for (auto& p : cloud2) { for (int j = 0; j < 3; ++j) { p[j] = 1.5f * uniform(generator) - 0.2f; } }
+	UnbalancedSliced sliced;
+	QuantileApproximation settings;
+	const double exact = sliced.correspondencesNd(cloud1, cloud2, 20);
+	const double approximate = sliced.correspondencesNd<3, float>(cloud1, cloud2, 20, false, nullptr, ProjectionKeys::full, &settings);
+	const bool consistent = approximate >= exact * (1. - 1e-4) && approximate - exact <= settings.extra_cost_bound * (1. + 1e-4) + 1e-6;
+	std::cout << fmt::format("correspondencesNd() : exact {}, approximate {}, bound {}", exact, approximate, settings.extra_cost_bound) << '\n';
+	success &= consistent;
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,65 @@
+//
+// Checks the early stopping of the barycenters : with a tolerance they must stop before niters, at the barycenter they
+// would reach by running exactly that many iterations, and their trace must record each iteration. The adaptive step
+// must not leave the barycenter further from the clouds. Keeping the sorted projections of the clouds across iterations,
+// for all, some or none of the slices, must not change the barycenter.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+int main() {
+	bool success = true;
+	std::mt19937 generator(22);
+	std::normal_distribution<float> normal(0.f, 1.f);
+	std::vector<std::vector<Point<3, float> > > clouds(2);
+	clouds[0].resize(3000);
+	clouds[1].resize(4000);
+	for (auto& p : clouds[0]) { for (int j = 0; j < 3; ++j) { p[j] = normal(generator); } }
+	for (auto& p : clouds[1]) { for (int j = 0; j < 3; ++j) { p[j] = 0.5f * normal(generator) + 3.f; } }
+	const std::vector<float> weights{0.5f, 0.5f};
+	const int niters = 200, nslices = 32, Mbary = 1000;
+
+	UnbalancedSliced sliced;
+	std::vector<Point<3, float> > full, stopped, fixed;
+	const BarycenterTrace full_trace = sliced.unbalanced_barycenter(Mbary, niters, nslices, weights, clouds, full);
+	success &= full_trace.iterations == niters && !full_trace.converged && full_trace.costs.size() == niters;
+
+	sliced.barycenter_tolerance = 1e-3;
+	const BarycenterTrace trace = sliced.unbalanced_barycenter(Mbary, niters, nslices, weights, clouds, stopped);
+	std::cout << fmt::format("Converged in {} iterations : cost {} -> {}, displacement {} -> {}", trace.iterations, trace.costs.front(), trace.costs.back(), trace.displacements.front(), trace.displacements.back()) << '\n';
+	success &= trace.converged && trace.iterations < niters;
+	success &= trace.costs.size() == trace.iterations && trace.displacements.size() == trace.iterations && trace.steps.size() == trace.iterations;
+	success &= trace.costs.back() < 0.5 * trace.costs.front() && trace.costs.back() <= 1.01 * full_trace.costs.back();
+
+	sliced.barycenter_tolerance = 0;
+	sliced.unbalanced_barycenter(Mbary, trace.iterations, nslices, weights, clouds, fixed);
+	success &= fixed == stopped;
+
+	sliced.barycenter_adaptive_step = true;
+	const BarycenterTrace adaptive = sliced.unbalanced_barycenter(Mbary, niters, nslices, weights, clouds, stopped);
+	std::cout << fmt::format("Adaptive step : cost {}, last step {}", adaptive.costs.back(), adaptive.steps.back()) << '\n';
+	success &= adaptive.costs.back() <= 1.01 * full_trace.costs.back();
+	for (double step : adaptive.steps) {
+		success &= step > 0 && step <= 1;
+	}
+
+	sliced.barycenter_adaptive_step = false;
+	for (std::size_t max_bytes : {std::size_t(0), 10 * (clouds[0].size() + clouds[1].size()) * sizeof(float)}) {
+		UnbalancedSliced uncached;
+		uncached.barycenter_cache_max_bytes = max_bytes;
+		uncached.unbalanced_barycenter(Mbary, 20, nslices, weights, clouds, stopped);
+		sliced.unbalanced_barycenter(Mbary, 20, nslices, weights, clouds, fixed);
+		success &= fixed == stopped;
+	}
+
+	// The weighted barycenter with unit masses :
+	const std::vector<std::vector<float> > masses{std::vector<float>(clouds[0].size(), 1.f), std::vector<float>(clouds[1].size(), 1.f)};
+	std::vector<float> bary_masses;
+	sliced.barycenter_tolerance = 1e-3;
+	const BarycenterTrace weighted = sliced.weighted_unbalanced_barycenter(Mbary, niters, nslices, weights, clouds, masses, stopped, bary_masses);
+	std::cout << fmt::format("Weighted : converged in {} iterations, cost {} -> {}", weighted.iterations, weighted.costs.front(), weighted.costs.back()) << '\n';
+	success &= weighted.converged && weighted.iterations < niters && weighted.costs.back() < 0.5 * weighted.costs.front();
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
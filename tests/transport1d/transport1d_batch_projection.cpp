@@ -0,0 +1,44 @@
+//
+// Checks the blocked projection onto batches of directions against the projection of each sample by Projector, on
+// clouds whose size is not a multiple of the block, in 2 and 5 dimensions, and for a batch of a single direction.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+template<int DIM>
+bool check(int n, int K, std::mt19937& generator) {
+	std::normal_distribution<float> normal(0.f, 1.f);
+	std::vector<Point<DIM, float> > cloud(n), dirs(K);
+	for (auto& p : cloud) { for (int j = 0; j < DIM; ++j) { p[j] = 10.f * normal(generator); } }
+	DirectionGenerator<DIM, float> directions(DirectionSampling::gaussian, K);
+	for (auto& d : dirs) { d = directions.next(); }
+
+	std::vector<std::vector<float> > projections(K, std::vector<float>(n));
+	std::vector<float*> projections_ptr(K);
+	for (int k = 0; k < K; ++k) { projections_ptr[k] = projections[k].data(); }
+	BatchProjector<DIM, float>(dirs.data(), K).project(cloud.data(), n, projections_ptr.data());
+
+	double error = 0.;
+	for (int k = 0; k < K; ++k) {
+		Projector<DIM, float> proj(dirs[k]);
+		for (int i = 0; i < n; ++i) {
+			error = std::max(error, static_cast<double>(std::abs(projections[k][i] - proj.proj(cloud[i]))));
+		}
+	}
+	std::cout << fmt::format("{}d, {} samples x {} directions : max error {}", DIM, n, K, error) << '\n';
+	return error <= 1e-4;
+}
+
+int main() {
+	bool success = true;
+	std::mt19937 generator(17);
+
+	success &= check<2>(1, 1, generator);
+	success &= check<2>(1000, 7, generator);
+	success &= check<3>(257, 64, generator);
+	success &= check<3>(100000, 32, generator);
+	success &= check<5>(3001, 13, generator);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,64 @@
+//
+// Checks that the 1D solver finds an optimal partial assignment for each of the cost policies, against the O(MN)
+// dynamic program over monotone assignments.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+/// @brief Computes the optimal partial transport cost of sorted hist1 into sorted hist2, in O(MN).
+template<typename Cost>
+double reference_cost(const double* hist1, const double* hist2, int M, int N) {
+	// best[j] : cost of matching the first i samples of hist1 into the first j samples of hist2.
+	std::vector<double> best(N + 1, 0.), previous;
+	for (int i = 1; i <= M; ++i) {
+		previous.swap(best);
+		best.assign(N + 1, std::numeric_limits<double>::max());
+		for (int j = i; j <= N; ++j) {
+			best[j] = std::min(best[j - 1], previous[j - 1] + Cost::cost(hist1[i - 1], hist2[j - 1]));
+		}
+	}
+	return best[N];
+}
+
+/// @brief Solves random problems, with many ties, and checks the cost of the assignment is optimal.
+template<typename Cost>
+bool check_policy(const std::string& name) {
+	UnbalancedSliced sliced;
+	std::mt19937 generator(7);
+	std::uniform_real_distribution<double> uniform(0., 1.);
+	double worst_error = 0.;
+	for (int problem = 0; problem < 500; ++problem) {
+		const int M = 1 + static_cast<int>(generator() % 80);
+		const int N = M + (problem % 10 == 0 ? 0 : static_cast<int>(generator() % 80)); // some balanced problems
+		double* hist1 = static_cast<double*>(malloc_simd(M * sizeof(double), 32));
+		double* hist2 = static_cast<double*>(malloc_simd(N * sizeof(double), 32));
+		for (int i = 0; i < M; ++i) { hist1[i] = (generator() % 4 == 0) ? std::round(uniform(generator) * 10.) / 10. : uniform(generator); }
+		for (int i = 0; i < N; ++i) { hist2[i] = (generator() % 4 == 0) ? std::round(uniform(generator) * 10.) / 10. : uniform(generator); }
+		std::sort(hist1, hist1 + M);
+		std::sort(hist2, hist2 + N);
+
+		std::vector<int> assignment;
+		const double emd = sliced.transport1d<double, Cost>(hist1, hist2, M, N, assignment);
+		double assigned = 0.;
+		for (int i = 0; i < M; ++i) {
+			assigned += Cost::cost(hist1[i], hist2[assignment[i]]);
+		}
+		const double reference = reference_cost<Cost>(hist1, hist2, M, N);
+		worst_error = std::max(worst_error, std::abs(emd - reference) / std::max(reference, 1e-12));
+		worst_error = std::max(worst_error, std::abs(assigned - reference) / std::max(reference, 1e-12));
+
+		free_simd(hist1);
+		free_simd(hist2);
+	}
+	std::cout << fmt::format("{} : worst relative error {}", name, worst_error) << '\n';
+	return worst_error < 1e-8;
+}
+
+int main() {
+	bool success = true;
+	success &= check_policy<SquaredCost>("SquaredCost");
+	success &= check_policy<L1Cost>("L1Cost");
+	success &= check_policy<PowerCost<3>>("PowerCost<3>");
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,98 @@
+//
+// Checks that the 1D solver returns bit-identical assignments and EMDs, whatever the number of threads used, and that
+// the batched solver returns the same results as the per-slice one. The sliced distance must also be the same with any
+// batch size, and with a workspace reused across calls (warm-started sorts and cached target projections).
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+#include <cstring>
+
+/// @brief Holds K sorted 1D histogram pairs, allocated with the alignment transport1d() expects.
+struct Slices {
+	explicit Slices(int K) : hist1(K), hist2(K), M(K), N(K) {
+		std::mt19937 generator(42);
+		for (int k = 0; k < K; ++k) {
+			// A few slices are large enough for the parallel front end of transport1d().
+			M[k] = (k % 16 == 15 ? UnbalancedSliced::parallel_front_end_size : 1) + static_cast<int>(generator() % 3000);
+			N[k] = M[k] + (k % 5 == 0 ? 0 : static_cast<int>(generator() % 3000));
+			std::normal_distribution<float> source(static_cast<float>(k % 7) * 0.1f, 1.f), target(0.f, 1.5f);
+			float* h1 = static_cast<float*>(malloc_simd(M[k] * sizeof(float), 32));
+			float* h2 = static_cast<float*>(malloc_simd(N[k] * sizeof(float), 32));
+			for (int i = 0; i < M[k]; ++i) { h1[i] = source(generator); }
+			for (int i = 0; i < N[k]; ++i) { h2[i] = target(generator); }
+			std::sort(h1, h1 + M[k]);
+			std::sort(h2, h2 + N[k]);
+			hist1[k] = h1;
+			hist2[k] = h2;
+		}
+	}
+	~Slices() {
+		for (std::size_t k = 0; k < hist1.size(); ++k) {
+			free_simd(const_cast<float*>(hist1[k]));
+			free_simd(const_cast<float*>(hist2[k]));
+		}
+	}
+
+	std::vector<const float*> hist1, hist2;
+	std::vector<int> M, N;
+};
+
+/// @brief Solves all slices one at a time with the given number of threads.
+void solve_one_by_one(UnbalancedSliced& sliced, const Slices& slices, int threads, std::vector<std::vector<int>>& assignments, std::vector<float>& emds) {
+	omp_set_num_threads(threads);
+	TransportWorkspace<float> workspace;
+	assignments.resize(slices.hist1.size());
+	emds.resize(slices.hist1.size());
+	for (std::size_t k = 0; k < slices.hist1.size(); ++k) {
+		emds[k] = sliced.transport1d(slices.hist1[k], slices.hist2[k], slices.M[k], slices.N[k], assignments[k], workspace);
+	}
+}
+
+/// @brief Checks two sets of results are bit-identical.
+bool check_identical(const std::string& name, const std::vector<std::vector<int>>& ass_ref, const std::vector<float>& emd_ref,
+					 const std::vector<std::vector<int>>& ass, const std::vector<float>& emd) {
+	bool identical = ass_ref == ass && std::memcmp(emd_ref.data(), emd.data(), emd.size() * sizeof(float)) == 0;
+	std::cout << name << " : " << (identical ? "identical" : "DIFFERENT") << '\n';
+	return identical;
+}
+
+int main() {
+	UnbalancedSliced sliced;
+	Slices slices(64);
+
+	std::vector<std::vector<int>> ass_ref, ass;
+	std::vector<float> emd_ref, emd;
+	solve_one_by_one(sliced, slices, 1, ass_ref, emd_ref);
+
+	bool success = true;
+	for (int threads : {2, 7, 64}) {
+		solve_one_by_one(sliced, slices, threads, ass, emd);
+		success &= check_identical(fmt::format("transport1d() with {} threads", threads), ass_ref, emd_ref, ass, emd);
+
+		TransportBatchWorkspace<float> workspace;
+		sliced.transport1d_batch(slices.hist1, slices.hist2, slices.M, slices.N, ass, emd, workspace);
+		success &= check_identical(fmt::format("transport1d_batch() with {} threads", threads), ass_ref, emd_ref, ass, emd);
+	}
+
+	omp_set_num_threads(4);
+	std::mt19937 generator(7);
+	std::normal_distribution<float> normal(0.f, 1.f);
+	std::vector<Point<3, float> > cloud1(5000), cloud2(7000);
+	for (auto& p : cloud1) { for (int j = 0; j < 3; ++j) { p[j] = normal(generator); } }
+	for (auto& p : cloud2) { for (int j = 0; j < 3; ++j) { p[j] = 1.5f * normal(generator) + 0.2f; } }
+	const double distance_ref = sliced.sliced_distance(cloud1, cloud2, 50, 1);
+	SortedProjectionCache<float> cache;
+	TransportWorkspace<float> workspace;
+	workspace.target_projections = &cache;
+	for (int batch_size : {0, 3, 64}) {
+		const double distance = sliced.sliced_distance(cloud1, cloud2, 50, batch_size, &workspace);
+		const bool identical = distance == distance_ref && distance == sliced.sliced_distance(cloud1, cloud2, 50, batch_size);
+		std::cout << fmt::format("sliced_distance() in batches of {} : {}", batch_size, identical ? "identical" : "DIFFERENT") << '\n';
+		success &= identical;
+	}
+	success &= sliced.correspondencesNd(cloud1, cloud2, 50, false, &workspace) == distance_ref;
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,83 @@
+//
+// Checks the direction generators : unit directions, orthonormal frames, a reproducible low-discrepancy set, and a
+// sliced distance closer to its many-slice limit with few low-discrepancy slices than with as many gaussian ones.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+template<int DIM>
+bool check_directions(DirectionSampling sampling, int count) {
+	engine.seed(4);
+	DirectionGenerator<DIM, double> generator(sampling, count);
+	std::vector<Point<DIM, double> > dirs(count);
+	bool valid = true;
+	for (int k = 0; k < count; ++k) {
+		dirs[k] = generator.next();
+		double n = 0;
+		for (int c = 0; c < DIM; ++c) { n += dirs[k][c] * dirs[k][c]; }
+		valid &= std::abs(n - 1) < 1e-9;
+	}
+	if (sampling == DirectionSampling::orthogonal_frames) {
+		for (int k = 0; k + DIM <= count; k += DIM) {
+			for (int i = k; i < k + DIM; ++i) {
+				for (int j = k; j < i; ++j) {
+					double dot = 0;
+					for (int c = 0; c < DIM; ++c) { dot += dirs[i][c] * dirs[j][c]; }
+					valid &= std::abs(dot) < 1e-9;
+				}
+			}
+		}
+	}
+	if (sampling == DirectionSampling::low_discrepancy) {
+		DirectionGenerator<DIM, double> again(sampling, count);
+		for (int k = 0; k < count; ++k) { valid &= again.next() == dirs[k]; }
+	}
+	if (!valid) {
+		std::cout << fmt::format("{} directions of dimension {}, sampling {} : invalid", count, DIM, static_cast<int>(sampling)) << '\n';
+	}
+	return valid;
+}
+
+int main() {
+	bool success = true;
+	for (DirectionSampling sampling : {DirectionSampling::gaussian, DirectionSampling::orthogonal_frames, DirectionSampling::low_discrepancy}) {
+		success &= check_directions<2>(sampling, 10);
+		success &= check_directions<3>(sampling, 30);
+		success &= check_directions<5>(sampling, 25);
+	}
+
+	// Sliced distances with 30 slices, against the one with 1000 gaussian slices, on randomly rotated problems :
+	std::mt19937 generator(3);
+	std::normal_distribution<float> normal(0.f, 1.f);
+	const DirectionSampling samplings[2] = {DirectionSampling::gaussian, DirectionSampling::low_discrepancy};
+	double errors[2] = {0, 0};
+	constexpr int problems = 20;
+	for (int problem = 0; problem < problems; ++problem) {
+		std::vector<Point<3, float> > cloud1(500), cloud2(700);
+		const float scales[3] = {1.f + 0.3f * (problem % 3), 0.5f, 2.f};
+		for (auto& p : cloud1) { for (int j = 0; j < 3; ++j) { p[j] = normal(generator) * scales[j]; } }
+		for (auto& p : cloud2) { for (int j = 0; j < 3; ++j) { p[j] = normal(generator) * scales[(j + 1) % 3] + 0.5f; } }
+		engine.seed(1000 + problem);
+		DirectionGenerator<3, float> rotation(DirectionSampling::orthogonal_frames, 3);
+		const Point<3, float> frame[3] = {rotation.next(), rotation.next(), rotation.next()};
+		for (auto* cloud : {&cloud1, &cloud2}) {
+			for (auto& p : *cloud) {
+				Point<3, float> q;
+				for (int i = 0; i < 3; ++i) { for (int j = 0; j < 3; ++j) { q[i] += frame[i][j] * p[j]; } }
+				p = q;
+			}
+		}
+
+		UnbalancedSliced sliced;
+		const double reference = sliced.sliced_distance<3, float>(cloud1, cloud2, 1000);
+		for (int m = 0; m < 2; ++m) {
+			sliced.direction_sampling = samplings[m];
+			errors[m] += std::abs(sliced.sliced_distance<3, float>(cloud1, cloud2, 30) - reference) / reference / problems;
+		}
+	}
+	std::cout << fmt::format("Mean relative error with 30 slices : gaussian {}, low-discrepancy {}", errors[0], errors[1]) << '\n';
+	success &= errors[1] < errors[0];
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
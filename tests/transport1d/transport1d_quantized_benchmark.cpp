@@ -0,0 +1,59 @@
+//
+// Times the front end of a slice on a large cloud : projecting it and sorting the projections with
+// radix_sort_projections(), as correspondencesNd() does, against sort_quantized_projections() with 16-bit keys. At each
+// rank, the sorted keys must be within the quantization error of the sorted projections. The number of samples can be
+// given as first argument.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+int main(int argc, char** argv) {
+	const int n = argc > 1 ? std::atoi(argv[1]) : 1 << 22;
+	const int slices = 8;
+
+	std::mt19937 generator(23);
+	std::uniform_int_distribution<int> colour(0, 255);
+	std::vector<Point<3, float> > cloud(n);
+	for (auto &p : cloud) { for (int j = 0; j < 3; ++j) { p[j] = float(colour(generator)); } }
+	BoundingBox<3, float> box;
+	box.add(cloud);
+
+	std::vector<float> projections(n), sorted(n), quantized(n);
+	std::vector<int> order(n), quantized_order(n);
+	std::vector<uint16_t> keys(n);
+	RadixSortWorkspace<float> radix_workspace;
+	CountingSortWorkspace counting_workspace;
+	double radix_time = 0., quantized_time = 0.;
+	bool success = true;
+	for (int slice = 0; slice < slices; ++slice) {
+		const Point<3, float> dir = random_direction<3, float>();
+		double lo, hi;
+		box.projection_range(dir, lo, hi);
+		const KeyQuantizer<float> quantizer(lo, hi);
+
+		auto start = micro_benchmarks::my_clock_t::now();
+		Projector<3, float> proj(dir);
+	#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i) {
+			projections[i] = proj.proj(cloud[i]);
+		}
+		radix_sort_projections(projections.data(), n, sorted.data(), order.data(), radix_workspace);
+		radix_time += std::chrono::duration<double, std::milli>(micro_benchmarks::my_clock_t::now() - start).count();
+
+		start = micro_benchmarks::my_clock_t::now();
+		sort_quantized_projections(cloud, dir, quantizer, keys.data(), quantized.data(), quantized_order.data(), counting_workspace);
+		quantized_time += std::chrono::duration<double, std::milli>(micro_benchmarks::my_clock_t::now() - start).count();
+
+		// The keys are monotonic : the i-th key sorted is within the quantization error of the i-th projection sorted.
+		double worst_error = 0.;
+		for (int i = 0; i < n; ++i) {
+			worst_error = std::max(worst_error, std::abs(double(quantized[i]) - sorted[i]));
+		}
+		success &= worst_error <= quantizer.max_error() + 1e-4;
+	}
+	std::cout << fmt::format("{} samples, {} threads : radix sort {:.2f} ms, 16-bit keys {:.2f} ms per slice ({:.2f}x)",
+							 n, omp_get_max_threads(), radix_time / slices, quantized_time / slices, radix_time / quantized_time) << '\n';
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
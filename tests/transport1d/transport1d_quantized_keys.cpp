@@ -0,0 +1,155 @@
+//
+// Checks the 16-bit projection keys : the counting sort must give the same order as sorting (projection, index) pairs,
+// also when split among threads on a large cloud,
+// dequantized keys must stay within quantized_key_error() of the projections, and the 1D solver must return injective,
+// optimal assignments on the many ties they produce.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+/// @brief Computes the optimal partial transport cost of sorted hist1 into sorted hist2, in O(MN).
+double reference_cost(const float* hist1, const float* hist2, int M, int N) {
+	std::vector<double> best(N + 1, 0.), previous;
+	for (int i = 1; i <= M; ++i) {
+		previous.swap(best);
+		best.assign(N + 1, std::numeric_limits<double>::max());
+		for (int j = i; j <= N; ++j) {
+			best[j] = std::min(best[j - 1], previous[j - 1] + cost(double(hist1[i - 1]), double(hist2[j - 1])));
+		}
+	}
+	return best[N];
+}
+
+int main() {
+	std::mt19937 generator(11);
+	std::uniform_int_distribution<int> colour(0, 255);
+	std::vector<Point<3, float> > cloud1(2000), cloud2(3000);
+	for (auto &p : cloud1) { for (int j = 0; j < 3; ++j) { p[j] = float(colour(generator)); } }
+	for (auto &p : cloud2) { for (int j = 0; j < 3; ++j) { p[j] = float(colour(generator)) * 0.5f + 60.f; } }
+
+	bool success = true;
+	const double bound = quantized_key_error(cloud1, cloud2);
+	BoundingBox<3, float> box;
+	box.add(cloud1);
+	box.add(cloud2);
+
+	std::vector<uint16_t> keys(cloud1.size());
+	std::vector<int> order(cloud1.size());
+	CountingSortWorkspace counting_workspace;
+	std::vector<std::pair<uint16_t, int> > pairs(cloud1.size());
+	double worst_error = 0.;
+	for (int slice = 0; slice < 20; ++slice) {
+		Point<3, float> dir = random_direction<3, float>();
+		double lo, hi;
+		box.projection_range(dir, lo, hi);
+		const KeyQuantizer<float> quantizer(lo, hi);
+		Projector<3, float> proj(dir);
+		for (int i = 0; i < cloud1.size(); ++i) {
+			const double projection = proj.proj(cloud1[i]);
+			keys[i] = quantizer.quantize(projection);
+			pairs[i] = std::make_pair(keys[i], i);
+			worst_error = std::max(worst_error, std::abs(quantizer.dequantize(keys[i]) - projection));
+		}
+		counting_sort(keys.data(), static_cast<int>(keys.size()), order.data(), counting_workspace);
+		std::sort(pairs.begin(), pairs.end());
+		for (int i = 0; i < pairs.size(); ++i) {
+			success &= order[i] == pairs[i].second;
+		}
+	}
+	std::cout << fmt::format("counting_sort() : {}", success ? "same order as std::sort()" : "DIFFERENT ORDER") << '\n';
+
+	{
+		std::vector<Point<3, float> > large(radix_sort_parallel_size + 1000);
+		for (auto &p : large) { for (int j = 0; j < 3; ++j) { p[j] = float(colour(generator)); } }
+		BoundingBox<3, float> large_box;
+		large_box.add(large);
+		const Point<3, float> dir = random_direction<3, float>();
+		double lo, hi;
+		large_box.projection_range(dir, lo, hi);
+		const KeyQuantizer<float> quantizer(lo, hi);
+		std::vector<uint16_t> large_keys(large.size());
+		std::vector<float> sorted(large.size());
+		std::vector<int> large_order(large.size());
+		omp_set_num_threads(4);
+		sort_quantized_projections(large, dir, quantizer, large_keys.data(), sorted.data(), large_order.data(), counting_workspace);
+		std::vector<std::pair<uint16_t, int> > large_pairs(large.size());
+		Projector<3, float> proj(dir);
+		for (int i = 0; i < large.size(); ++i) {
+			large_pairs[i] = std::make_pair(quantizer.quantize(proj.proj(large[i])), i);
+		}
+		std::sort(large_pairs.begin(), large_pairs.end());
+		bool same = true;
+		for (int i = 0; i < large.size(); ++i) {
+			same &= large_order[i] == large_pairs[i].second && sorted[i] == quantizer.dequantize(large_pairs[i].first);
+		}
+		std::cout << fmt::format("sort_quantized_projections() on 4 threads : {}", same ? "same order as std::sort()" : "DIFFERENT ORDER") << '\n';
+		success &= same;
+	}
+	// Dequantization is done in float : allow for its rounding on top of the bound.
+	const bool within_bound = worst_error <= bound + 1e-4;
+	std::cout << fmt::format("dequantized keys : worst error {}, bound {}", worst_error, bound) << '\n';
+	success &= within_bound;
+
+	// Heavily tied problems, as produced by the quantization of large clouds.
+	UnbalancedSliced sliced;
+	int non_injective = 0;
+	double worst_cost_error = 0.;
+	for (int problem = 0; problem < 2000; ++problem) {
+		const int M = 1 + static_cast<int>(generator() % 60);
+		const int N = M + static_cast<int>(generator() % 60);
+		const int levels = 2 + static_cast<int>(generator() % 30);
+		const KeyQuantizer<float> quantizer(0., 1.);
+		float* hist1 = static_cast<float*>(malloc_simd(M * sizeof(float), 32));
+		float* hist2 = static_cast<float*>(malloc_simd(N * sizeof(float), 32));
+		// Coarse levels give many ties ; the others fall anywhere in between.
+		auto key = [&]() { return static_cast<uint16_t>(generator() % 2 ? (generator() % levels) * (65535 / levels) : generator() % 65536); };
+		for (int i = 0; i < M; ++i) { hist1[i] = quantizer.dequantize(key()); }
+		for (int i = 0; i < N; ++i) { hist2[i] = quantizer.dequantize(key()); }
+		std::sort(hist1, hist1 + M);
+		std::sort(hist2, hist2 + N);
+
+		std::vector<int> assignment;
+		sliced.transport1d(hist1, hist2, M, N, assignment);
+		std::vector<char> used(N, 0);
+		double assigned = 0.;
+		bool injective = true;
+		for (int i = 0; i < M; ++i) {
+			injective &= !used[assignment[i]];
+			used[assignment[i]] = 1;
+			assigned += cost(double(hist1[i]), double(hist2[assignment[i]]));
+		}
+		non_injective += injective ? 0 : 1;
+		const double reference = reference_cost(hist1, hist2, M, N);
+		worst_cost_error = std::max(worst_cost_error, std::abs(assigned - reference) / std::max(reference, 1.));
+
+		free_simd(hist1);
+		free_simd(hist2);
+	}
+	std::cout << fmt::format("tied problems : {} non-injective, worst relative cost error {}", non_injective, worst_cost_error) << '\n';
+	// The solver compares costs in float.
+	success &= non_injective == 0 && worst_cost_error < 1e-5;
+
+	// Regression : reduce_range() used to leave a single sample whose nearest neighbor, among two equal targets, was out
+	// of its new range. It was then assigned to the target of its right neighbor.
+	{
+		const std::vector<double> source = {0.091782324641005497, 0.29883733903645304, 0.35176047681985934, 0.5, 0.74532810733555988, 0.77839288098678694, 0.8, 0.9};
+		const std::vector<double> target = {0.087559510969192192, 0.1, 0.15636646620095793, 0.2, 0.272204753598494, 0.28397320174706175, 0.3, 0.3, 0.3027263727478402, 0.31791878254086164, 0.7, 0.7, 0.99455260028812209};
+		double* hist1 = static_cast<double*>(malloc_simd(source.size() * sizeof(double), 32));
+		double* hist2 = static_cast<double*>(malloc_simd(target.size() * sizeof(double), 32));
+		std::copy(source.begin(), source.end(), hist1);
+		std::copy(target.begin(), target.end(), hist2);
+		std::vector<int> assignment;
+		sliced.transport1d(hist1, hist2, static_cast<int>(source.size()), static_cast<int>(target.size()), assignment);
+		bool increasing = true;
+		for (int i = 1; i < assignment.size(); ++i) {
+			increasing &= assignment[i] > assignment[i - 1];
+		}
+		std::cout << fmt::format("equal targets : {}", increasing ? "injective" : "NOT INJECTIVE") << '\n';
+		success &= increasing;
+		free_simd(hist1);
+		free_simd(hist2);
+	}
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+//
+// Checks the radix sort of the projections against std::sort on (projection, index) pairs : same sorted values and same
+// order, ties included, for floats and doubles, below and above the size at which the sort goes parallel. The warm-started
+// sort must give the same result, whether it repairs the previous permutation or falls back to the radix sort.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+template<typename T>
+bool check_sort(int n, int distinct, std::mt19937& generator, RadixSortWorkspace<T>& workspace) {
+	std::normal_distribution<T> normal(0, 100);
+	std::vector<T> levels(distinct);
+	for (T& level : levels) { level = normal(generator); }
+	levels[0] = T(0);
+	levels[distinct - 1] = -T(0);
+
+	std::vector<T> values(n);
+	std::vector<std::pair<T, int> > pairs(n);
+	for (int i = 0; i < n; ++i) {
+		values[i] = levels[generator() % distinct];
+		pairs[i] = std::make_pair(values[i], i);
+	}
+	std::sort(pairs.begin(), pairs.end());
+
+	std::vector<T> sorted(n);
+	std::vector<int> order(n);
+	radix_sort_projections(values.data(), n, sorted.data(), order.data(), workspace);
+	bool valid = true;
+	for (int i = 0; i < n; ++i) {
+		valid &= sorted[i] == pairs[i].first && order[i] == pairs[i].second;
+	}
+	if (!valid) {
+		std::cout << fmt::format("{} values ({} distinct), {}-byte samples : wrong order", n, distinct, sizeof(T)) << '\n';
+	}
+	return valid;
+}
+
+/// @brief Sorts projections moving by a growing amount, warm-started from the previous sort, and compares with std::sort.
+bool check_warm_sort(int n, std::mt19937& generator, RadixSortWorkspace<float>& workspace, WarmSortCache& cache) {
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::vector<float> values(n), sorted(n);
+	std::vector<int> order(n);
+	std::vector<std::pair<float, int> > pairs(n);
+	for (float& value : values) { value = std::floor(1000.f * uniform(generator)) / 1000.f; }
+	bool valid = true;
+	for (float motion : {0.f, 1e-4f, 1e-3f, 1e-2f, 1.f}) {
+		for (float& value : values) { value += motion * (uniform(generator) - 0.5f); }
+		for (int i = 0; i < n; ++i) { pairs[i] = std::make_pair(values[i], i); }
+		std::sort(pairs.begin(), pairs.end());
+		warm_sort_projections(values.data(), n, sorted.data(), order.data(), workspace, cache, 0);
+		for (int i = 0; i < n; ++i) {
+			valid &= sorted[i] == pairs[i].first && order[i] == pairs[i].second;
+		}
+		if (!valid) {
+			std::cout << fmt::format("{} values moving by {} : wrong warm-started order", n, motion) << '\n';
+			return false;
+		}
+	}
+	return valid;
+}
+
+int main() {
+	bool success = true;
+	std::mt19937 generator(13);
+	RadixSortWorkspace<float> float_workspace;
+	RadixSortWorkspace<double> double_workspace;
+	const int sizes[] = {1, 2, 17, 1000, 50000, radix_sort_parallel_size + 12345};
+	for (int n : sizes) {
+		for (int distinct : {2, 100, 1 << 20}) {
+			success &= check_sort<float>(n, distinct, generator, float_workspace);
+			success &= check_sort<double>(n, distinct, generator, double_workspace);
+		}
+	}
+
+	// Projections in a narrow range share their high bits : those passes are skipped.
+	std::vector<float> values(1000), sorted(1000);
+	std::vector<int> order(1000);
+	for (int i = 0; i < 1000; ++i) { values[i] = 1.f + static_cast<float>(generator() % 2048) * 1e-7f; }
+	radix_sort_projections(values.data(), 1000, sorted.data(), order.data(), float_workspace);
+	success &= std::is_sorted(sorted.begin(), sorted.end());
+
+	WarmSortCache cache;
+	cache.reserve(1);
+	for (int n : {1, 5, 1000, 100000}) {
+		success &= check_warm_sort(n, generator, float_workspace, cache);
+	}
+	// Without room for the permutation, every sort is a radix sort :
+	WarmSortCache capped;
+	capped.reserve(1);
+	capped.max_bytes = 0;
+	success &= check_warm_sort(1000, generator, float_workspace, capped) && capped.orders[0].empty() && capped.bytes == 0;
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,89 @@
+//
+// Checks the counters of the 1D solver, built with SPOT_ENABLE_TRANSPORT_STATS : each slice and each sub-problem must
+// be counted under exactly one path, and the batched solver must count the same paths as the per-slice one.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+using micro_benchmarks::TransportStats;
+
+/// @brief Checks the counters of stats are consistent with solving the given number of slices.
+bool check_consistent(const std::string& name, const TransportStats& stats, std::uint64_t slices) {
+	const std::uint64_t paths = stats.solved_equal_sizes + stats.solved_one_free_target + stats.solved_single_source +
+								stats.solved_injective_nearest_neighbors + stats.solved_by_reduce_range + stats.solved_by_simple_solve + stats.solved_approximately;
+	std::uint64_t histogram = 0;
+	for (std::uint64_t count : stats.subproblem_sizes) { histogram += count; }
+
+	bool success = stats.slices == slices && paths == stats.subproblems && histogram == stats.subproblems &&
+				   stats.slices_balanced + stats.slices_solved_by_reduce_range + stats.slices_not_split <= slices &&
+				   (stats.solved_by_simple_solve == 0 || (stats.largest_simple_solve_M > 1 && stats.largest_simple_solve_M < stats.largest_simple_solve_N));
+	std::cout << name << " : " << stats.subproblems << " sub-problems, " << stats.solved_by_simple_solve << " by simple_solve() "
+			  << (success ? "consistent" : "INCONSISTENT") << '\n';
+	return success;
+}
+
+/// @brief Checks the counters of two runs are the same. Times are not compared.
+bool check_same_paths(const TransportStats& a, const TransportStats& b) {
+	return a.slices == b.slices && a.slices_balanced == b.slices_balanced && a.slices_solved_by_reduce_range == b.slices_solved_by_reduce_range &&
+		   a.slices_not_split == b.slices_not_split && a.size_one_splits == b.size_one_splits && a.subproblems == b.subproblems &&
+		   a.solved_equal_sizes == b.solved_equal_sizes && a.solved_one_free_target == b.solved_one_free_target &&
+		   a.solved_single_source == b.solved_single_source && a.solved_injective_nearest_neighbors == b.solved_injective_nearest_neighbors &&
+		   a.solved_by_reduce_range == b.solved_by_reduce_range && a.solved_by_simple_solve == b.solved_by_simple_solve && a.solved_approximately == b.solved_approximately &&
+		   std::equal(std::begin(a.subproblem_sizes), std::end(a.subproblem_sizes), std::begin(b.subproblem_sizes)) &&
+		   a.largest_simple_solve_M == b.largest_simple_solve_M && a.largest_simple_solve_N == b.largest_simple_solve_N;
+}
+
+int main() {
+	if (not micro_benchmarks::transport_stats_enabled) {
+		std::cerr << "This test must be built with SPOT_ENABLE_TRANSPORT_STATS.\n";
+		return EXIT_FAILURE;
+	}
+
+	constexpr int K = 40;
+	std::mt19937 generator(5);
+	std::vector<const float*> hist1(K), hist2(K);
+	std::vector<int> M(K), N(K);
+	for (int k = 0; k < K; ++k) {
+		M[k] = 1 + static_cast<int>(generator() % 4000);
+		N[k] = M[k] + (k % 4 == 0 ? static_cast<int>(generator() % 3) : static_cast<int>(generator() % 4000));
+		std::normal_distribution<float> source(static_cast<float>(k % 5) * 0.2f, 1.f), target(0.f, 1.f + 0.1f * (k % 3));
+		float* h1 = static_cast<float*>(malloc_simd(M[k] * sizeof(float), 32));
+		float* h2 = static_cast<float*>(malloc_simd(N[k] * sizeof(float), 32));
+		for (int i = 0; i < M[k]; ++i) { h1[i] = source(generator); }
+		for (int i = 0; i < N[k]; ++i) { h2[i] = target(generator); }
+		std::sort(h1, h1 + M[k]);
+		std::sort(h2, h2 + N[k]);
+		hist1[k] = h1;
+		hist2[k] = h2;
+	}
+
+	UnbalancedSliced sliced;
+	TransportWorkspace<float> workspace;
+	std::vector<int> assignment;
+	for (int k = 0; k < K; ++k) {
+		sliced.transport1d(hist1[k], hist2[k], M[k], N[k], assignment, workspace);
+	}
+	bool success = check_consistent("transport1d()", workspace.stats, K);
+
+	TransportBatchWorkspace<float> batch_workspace;
+	std::vector<std::vector<int>> assignments;
+	std::vector<float> emds;
+	sliced.transport1d_batch(hist1, hist2, M, N, assignments, emds, batch_workspace);
+	success &= check_consistent("transport1d_batch()", batch_workspace.stats, K);
+	const bool same = check_same_paths(workspace.stats, batch_workspace.stats);
+	std::cout << "transport1d_batch() and transport1d() : " << (same ? "same paths" : "DIFFERENT paths") << '\n';
+	success &= same;
+
+	micro_benchmarks::TimingsLogger logger(1);
+	logger.get_transport_stats().merge(workspace.stats);
+	logger.get_transport_stats().merge(batch_workspace.stats);
+	success &= check_consistent("merged", logger.get_transport_stats(), 2 * K);
+	logger.get_transport_stats().print("");
+
+	for (int k = 0; k < K; ++k) {
+		free_simd(const_cast<float*>(hist1[k]));
+		free_simd(const_cast<float*>(hist2[k]));
+	}
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,62 @@
+//
+// Checks UnbalancedSliced::num_threads : the results must not depend on the number of threads, including for the quantized
+// projections whose two sorts run in parallel and for the barycenters, whose displacements are summed by all the threads
+// (also for their trace, on a barycenter large enough to be moved in parallel), and the OpenMP setting of the caller must be restored after each call.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+int main() {
+	omp_set_nested(0);
+
+	bool success = true;
+	std::mt19937 generator(19);
+	std::normal_distribution<float> normal(0.f, 1.f);
+	std::vector<Point<3, float> > cloud1(20000), cloud2(30000);
+	for (auto& p : cloud1) { for (int j = 0; j < 3; ++j) { p[j] = normal(generator); } }
+	for (auto& p : cloud2) { for (int j = 0; j < 3; ++j) { p[j] = 2.f * normal(generator) + 1.f; } }
+	std::vector<std::vector<Point<3, float> > > large(2, std::vector<Point<3, float> >(UnbalancedSliced::parallel_front_end_size + 1000));
+	for (auto& p : large[0]) { for (int j = 0; j < 3; ++j) { p[j] = normal(generator); } }
+	for (auto& p : large[1]) { for (int j = 0; j < 3; ++j) { p[j] = 0.5f * normal(generator) + 2.f; } }
+
+	const int caller_threads = omp_get_max_threads();
+	std::vector<double> distances, advected, quantized;
+	std::vector<std::vector<Point<3, float> > > barycenters, weighted_barycenters;
+	std::vector<std::vector<double> > large_displacements;
+	const std::vector<std::vector<float> > masses{std::vector<float>(cloud1.size(), 2.f), std::vector<float>(cloud2.size(), 1.f)};
+	for (int threads : {1, 2, 4}) {
+		UnbalancedSliced sliced;
+		sliced.num_threads = threads;
+		distances.push_back(sliced.correspondencesNd(cloud1, cloud2, 16));
+
+		std::vector<Point<3, float> > moved(cloud1);
+		advected.push_back(sliced.correspondencesNd(moved, cloud2, 16, true));
+		advected.back() += moved[123][0];
+
+		std::vector<Point<3, float> > moved_quantized(cloud1);
+		TransportWorkspace<float> workspace;
+		quantized.push_back(sliced.correspondencesNd(moved_quantized, cloud2, 16, true, &workspace, ProjectionKeys::quantized16));
+		quantized.back() += moved_quantized[123][0];
+
+		std::vector<Point<3, float> > bary;
+		sliced.unbalanced_barycenter(1000, 2, 8, std::vector<float>{0.5f, 0.5f}, std::vector<std::vector<Point<3, float> > >{cloud1, cloud2}, bary);
+		barycenters.push_back(bary);
+
+		std::vector<float> bary_masses;
+		sliced.weighted_unbalanced_barycenter(1000, 2, 8, std::vector<float>{0.5f, 0.5f}, std::vector<std::vector<Point<3, float> > >{cloud1, cloud2}, masses, bary, bary_masses);
+		weighted_barycenters.push_back(bary);
+
+		large_displacements.push_back(sliced.unbalanced_barycenter(static_cast<int>(large[0].size()), 2, 4, std::vector<float>{0.5f, 0.5f}, large, bary).displacements);
+
+		success &= omp_get_max_threads() == caller_threads;
+		std::cout << fmt::format("{} threads : {} {} {} {}", threads, distances.back(), advected.back(), quantized.back(), barycenters.back()[17][1]) << '\n';
+	}
+	for (int k = 1; k < distances.size(); ++k) {
+		success &= distances[k] == distances[0] && advected[k] == advected[0] && quantized[k] == quantized[0];
+		success &= barycenters[k] == barycenters[0] && weighted_barycenters[k] == weighted_barycenters[0];
+		success &= large_displacements[k] == large_displacements[0];
+	}
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,153 @@
+//
+// Checks the weighted-dirac solver : with integer masses, it must cost as much as transport1d() on the distributions with
+// duplicated samples, and its plan must move all the source mass within the target capacities. Tenths of these masses
+// must cost a tenth as much. The weighted correspondencesNd() of collapsed clouds must give the sliced distance of the
+// clouds with repeated samples.
+//
+
+#include "../../src/UnbalancedSliced.h"
+#include "../../external/fmt_bridge.hpp"
+
+int main() {
+	bool success = true;
+	UnbalancedSliced sliced;
+	WeightedTransportWorkspace<float> weighted_workspace;
+	TransportWorkspace<float> workspace;
+	std::mt19937 generator(5);
+
+	for (int problem = 0; problem < 200; ++problem) {
+		const int M = 1 + static_cast<int>(generator() % 1000);
+		const int N = 1 + static_cast<int>(generator() % 1000);
+		std::normal_distribution<float> source(static_cast<float>(problem % 5) * 0.2f, 1.f), target(0.f, 1.f + 0.2f * (problem % 3));
+		std::vector<float> hist1(M), hist2(N), mass1(M), mass2(N);
+		for (int i = 0; i < M; ++i) { hist1[i] = source(generator); }
+		for (int j = 0; j < N; ++j) { hist2[j] = target(generator); }
+		std::sort(hist1.begin(), hist1.end());
+		std::sort(hist2.begin(), hist2.end());
+		int units1 = 0, units2 = 0;
+		for (int i = 0; i < M; ++i) { mass1[i] = static_cast<float>(generator() % 4); units1 += static_cast<int>(mass1[i]); }
+		for (int j = 0; j < N; ++j) { mass2[j] = static_cast<float>(1 + generator() % 5); units2 += static_cast<int>(mass2[j]); }
+		if (units1 > units2) {
+			mass2[N - 1] += static_cast<float>(units1 - units2);
+			units2 = units1;
+		}
+
+		// The same problem, with each sample repeated once per unit of mass :
+		float* duplicated1 = static_cast<float*>(malloc_simd(std::max(units1, 1) * sizeof(float), 32));
+		float* duplicated2 = static_cast<float*>(malloc_simd(units2 * sizeof(float), 32));
+		for (int i = 0, u = 0; i < M; ++i) { for (int k = 0; k < mass1[i]; ++k) { duplicated1[u++] = hist1[i]; } }
+		for (int j = 0, u = 0; j < N; ++j) { for (int k = 0; k < mass2[j]; ++k) { duplicated2[u++] = hist2[j]; } }
+		std::vector<int> assignment;
+		const double expected = units1 > 0 ? sliced.transport1d(duplicated1, duplicated2, units1, units2, assignment, workspace) : 0.;
+
+		std::vector<TransportPlanEntry<float> > plan;
+		const double weighted = sliced.weighted_transport1d(hist1.data(), mass1.data(), M, hist2.data(), mass2.data(), N, plan, weighted_workspace);
+
+		std::vector<float> moved1(M, 0.f), moved2(N, 0.f);
+		double assigned = 0.;
+		bool valid = true;
+		for (std::size_t k = 0; k < plan.size(); ++k) {
+			const TransportPlanEntry<float>& entry = plan[k];
+			valid &= k == 0 || entry.source > plan[k - 1].source || (entry.source == plan[k - 1].source && entry.target > plan[k - 1].target);
+			moved1[entry.source] += entry.mass;
+			moved2[entry.target] += entry.mass;
+			assigned += entry.mass * cost(hist1[entry.source], hist2[entry.target]);
+		}
+		for (int i = 0; i < M; ++i) { valid &= moved1[i] == mass1[i]; }
+		for (int j = 0; j < N; ++j) { valid &= moved2[j] <= mass2[j]; }
+		const double tolerance = 1e-4 * std::max(expected, 1.);
+		valid &= std::abs(weighted - expected) <= tolerance && std::abs(assigned - weighted) <= tolerance;
+		if (!valid) {
+			std::cout << fmt::format("Problem {} ({} x {}, {} x {} units) : expected {}, weighted {}, plan {}", problem, M, N, units1, units2, expected, weighted, assigned) << '\n';
+		}
+		success &= valid;
+
+		// The same problem, with fractional masses :
+		std::vector<float> tenths1(M), tenths2(N);
+		for (int i = 0; i < M; ++i) { tenths1[i] = 0.1f * mass1[i]; }
+		for (int j = 0; j < N; ++j) { tenths2[j] = 0.1f * mass2[j]; }
+		const double fractional = sliced.weighted_transport1d(hist1.data(), tenths1.data(), M, hist2.data(), tenths2.data(), N, plan, weighted_workspace);
+		std::vector<double> fractional1(M, 0.), fractional2(N, 0.);
+		for (const TransportPlanEntry<float>& entry : plan) {
+			fractional1[entry.source] += entry.mass;
+			fractional2[entry.target] += entry.mass;
+		}
+		valid = std::abs(fractional - 0.1 * expected) <= 0.1 * tolerance;
+		for (int i = 0; i < M; ++i) { valid &= std::abs(fractional1[i] - tenths1[i]) <= 1e-5; }
+		for (int j = 0; j < N; ++j) { valid &= fractional2[j] <= tenths2[j] + 1e-5; }
+		if (!valid) {
+			std::cout << fmt::format("Problem {} with tenths of the masses : expected {}, weighted {}", problem, 0.1 * expected, fractional) << '\n';
+		}
+		success &= valid;
+
+		free_simd(duplicated1);
+		free_simd(duplicated2);
+	}
+
+	// Masses that add up to the same total, up to their rounding, are balanced :
+	{
+		std::vector<float> hist1(10), mass1(10, 0.3f);
+		const float hist2[1] = {0.5f};
+		const float mass2[1] = {3.f};
+		for (int i = 0; i < 10; ++i) { hist1[i] = 0.1f * static_cast<float>(i); }
+		std::vector<TransportPlanEntry<float> > plan;
+		double expected = 0.;
+		for (int i = 0; i < 10; ++i) { expected += 0.3 * cost(hist1[i], hist2[0]); }
+		bool valid = false;
+		try {
+			const double weighted = sliced.weighted_transport1d(hist1.data(), mass1.data(), 10, hist2, mass2, 1, plan);
+			valid = plan.size() == 10 && std::abs(weighted - expected) <= 1e-5;
+			for (const TransportPlanEntry<float>& entry : plan) { valid &= std::abs(entry.mass - 0.3f) <= 1e-6f; }
+		} catch (const std::invalid_argument&) {
+			valid = false;
+		}
+		if (!valid) {
+			std::cout << "Ten sources of mass 0.3 were not moved to a target of mass 3." << '\n';
+		}
+		success &= valid;
+	}
+
+	// More source than target mass is an error :
+	{
+		const float hist[2] = {0.f, 1.f};
+		const float mass1[2] = {2.f, 2.f};
+		const float mass2[2] = {1.f, 2.f};
+		std::vector<TransportPlanEntry<float> > plan;
+		bool thrown = false;
+		try {
+			sliced.weighted_transport1d(hist, mass1, 2, hist, mass2, 2, plan);
+		} catch (const std::invalid_argument&) {
+			thrown = true;
+		}
+		success &= thrown;
+	}
+
+	// Clouds of few distinct colors, as the pixels of an image :
+	std::uniform_int_distribution<int> level(0, 7);
+	std::vector<Point<3, float> > cloud1(4000), cloud2(6000);
+	for (auto& p : cloud1) { for (int j = 0; j < 3; ++j) { p[j] = static_cast<float>(level(generator)); } }
+	for (auto& p : cloud2) { for (int j = 0; j < 3; ++j) { p[j] = 1.5f * static_cast<float>(level(generator)) - 2.f; } }
+	std::vector<Point<3, float> > unique1, unique2;
+	std::vector<float> masses1, masses2;
+	std::vector<int> index1;
+	collapse_duplicates(cloud1, unique1, masses1, &index1);
+	collapse_duplicates(cloud2, unique2, masses2);
+	bool collapsed = unique1.size() <= 512 && unique2.size() <= 512;
+	for (int i = 0; i < cloud1.size(); ++i) {
+		collapsed &= unique1[index1[i]] == cloud1[i];
+	}
+	success &= collapsed;
+
+	const double expected = sliced.correspondencesNd(cloud1, cloud2, 20);
+	const double weighted = sliced.weighted_correspondencesNd(unique1, masses1, unique2, masses2, 20);
+	std::cout << fmt::format("{} x {} samples, {} x {} distinct : sliced distance {}, weighted {}", cloud1.size(), cloud2.size(), unique1.size(), unique2.size(), expected, weighted) << '\n';
+	success &= std::abs(weighted - expected) <= 1e-4 * expected;
+
+	// Advecting the distinct samples must bring them closer to the target :
+	sliced.weighted_correspondencesNd(unique1, masses1, unique2, masses2, 50, true);
+	const double advected = sliced.weighted_correspondencesNd(unique1, masses1, unique2, masses2, 20);
+	std::cout << fmt::format("After advection : weighted {}", advected) << '\n';
+	success &= advected < 0.5 * weighted;
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}